@@ -11,11 +11,21 @@
 #define _IOModule_H_
 
 #include <history.h>
+#include <parser.h>
 
 #define print_info(s,...)  printf(C_INFO s C_DEFAULT, ## __VA_ARGS__); fflush(stdout)
 #define print_error(s,...) printf(C_ERROR s C_DEFAULT, ## __VA_ARGS__); fflush(stdout)
 #define print_errno(s, ...) perror(C_ERROR s); printf(C_DEFAULT); fflush(stdout)
 
-char * getCommand(History * hist);
+/**
+ * Lee un comando de la terminal, lo guarda en el historial y lo analiza.
+ * 
+ * @param hist  Dirección del historial.
+ * @param cl    Aquí se deja el comando analizado; sus vistas son válidas hasta
+ *              la siguiente llamada.
+ * @return      El comando, o NULL si la línea estaba vacía.
+ */
+
+char * getCommand(History * hist, CommandLine * cl);
 
 #endif
@@ -0,0 +1,61 @@
+/**
+ * Contiene utilidades comunes que la shell ejecuta ella misma en lugar de
+ * buscar el programa: true, false, echo, printf, sleep y test. Fuera de una
+ * tubería se ejecutan sin crear un proceso (salvo sleep, para poder detenerlo
+ * con Ctrl-Z); dentro, en un hilo de la shell (o en un proceso hijo, en
+ * background). Cada manejador escribe en p->out y deja
+ * su código de salida en p->info.
+ * 
+ * @file  builtins.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <jobs_control.h>
+
+/**
+ * true: termina con éxito.
+ */
+
+void cmd_true_handler(Process * p);
+
+/**
+ * false: termina con error.
+ */
+
+void cmd_false_handler(Process * p);
+
+/**
+ * echo [-n] [argumentos...]: escribe los argumentos separados por un espacio y
+ * un salto de línea al final, salvo con -n.
+ */
+
+void cmd_echo_handler(Process * p);
+
+/**
+ * printf formato [argumentos...]: escribe los argumentos según el formato, con
+ * las conversiones %s %c %d %i %u %o %x %X %e %f %g y los escapes \n \t... Si
+ * sobran argumentos, el formato se vuelve a aplicar.
+ */
+
+void cmd_printf_handler(Process * p);
+
+/**
+ * sleep N[s|m|h|d]...: espera la suma de los intervalos. Ctrl-C la interrumpe;
+ * en un hilo, termina cuando se marca p->interrupted.
+ */
+
+void cmd_sleep_handler(Process * p);
+
+/**
+ * test expresión: evalúa -n -z, -e -f -d -r -w -x -s -L, = !=, -eq -ne -lt -le
+ * -gt -ge y la negación !. Termina con 0 si es cierta, 1 si no y 2 si la
+ * expresión no es válida.
+ */
+
+void cmd_test_handler(Process * p);
+
+#endif /* BUILTINS_H */
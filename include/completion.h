@@ -0,0 +1,65 @@
+/**
+ * Contiene el completado con el tabulador. Los nombres salen de índices
+ * ordenados en memoria: uno con los comandos internos y los ejecutables del
+ * PATH, y otro por cada directorio listado recientemente. Los índices se
+ * invalidan con inotify cuando cambian sus directorios, así que completar no
+ * tiene que recorrer el sistema de ficheros en cada pulsación.
+ *
+ * @file  completion.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+// Resultado de completar una palabra.
+typedef struct {
+    const char ** match;            // Candidatos, en orden alfabético.
+    int count;                      // Número de candidatos.
+    int typed;                      // Caracteres de los candidatos que ya están escritos.
+    int common;                     // Longitud del prefijo común a todos los candidatos.
+} Completions;
+
+/**
+ * Añade un comando interno a los nombres de comando.
+ *
+ * @param name  Nombre del comando.
+ */
+
+void addBuiltin(const char * name);
+
+/**
+ * Indica que el argumento de un comando es un número de trabajo.
+ *
+ * @param name  Nombre del comando (fg, bg...).
+ */
+
+void addJobCommand(const char * name);
+
+/**
+ * Establece la función que cuenta los trabajos numerados.
+ *
+ * @param count  Devuelve cuántos trabajos hay (se numeran desde 1).
+ */
+
+void setJobCounter(int (*count)());
+
+/**
+ * Completa la palabra que acaba en la posición len de la línea. Según su
+ * posición se completa un comando, un número de trabajo o una ruta.
+ *
+ * @param line    Línea escrita.
+ * @param len     Posición del cursor; la palabra empieza tras el último espacio.
+ * @param result  Aquí se dejan los candidatos, válidos hasta la siguiente llamada.
+ */
+
+void completeWord(const char * line, int len, Completions * result);
+
+/**
+ * Libera los índices y el descriptor de inotify.
+ */
+
+void destroyCompletion();
+
+#endif /* COMPLETION_H */
@@ -12,8 +12,33 @@
 // Commands parameters.
 #define MAX_LINE_COMMAND 256
 #define MAX_ARGS 32
+#define MAX_STAGES 16
+
+// Historial.
+#define HIST_FILE ".shell_history"       // Fichero del historial, en $HOME.
+#define HIST_INDEX ".shell_history.idx"  // Índice de posiciones del historial, en $HOME.
+#define HIST_CAPACITY 1000               // Entradas que se conservan en memoria.
+#define HIST_PREFIX_DEPTH 16             // Caracteres de cada entrada en el árbol de prefijos.
+#define HIST_PREFIX_POSTINGS 256         // Entradas más recientes que guarda cada nodo del árbol.
+#define HIST_INDEX_STEP 4096             // Entradas del fichero en el primer tramo que se indexa.
+#define HIST_OVERLAYS 8                  // Copias para editar entradas que se reservan al principio.
+#define HIST_REFS 4                      // Entradas fuera de memoria que se pueden expandir en una línea.
+
+// Control de trabajos.
+#define MAX_DEPS 16              // Máximo de dependencias de un trabajo (after).
+#define MAX_BG_JOBS 0            // Trabajos en background simultáneos (0, sin límite).
+#define PRESSURE_SUSTAIN 3       // Segundos de presión de memoria antes de detener un trabajo.
+#define OUTPUT_RING_SIZE 65536   // Bytes que se guardan de la salida de un trabajo capturado.
+#define MAX_OUTPUTS 16           // Salidas capturadas que se conservan.
+#define MUX_BUFFER 65536         // Bytes por lectura y por escritura del multiplexor.
+#define MUX_LINE 4096            // Longitud máxima de una línea del multiplexor.
+#define MUX_TAG 64               // Longitud máxima de la etiqueta de una línea.
 
 // I/O Parameters.
+#define INPUT_BUFFER 4096        // Bytes que se leen de la terminal de una vez.
+#define COMPL_DIRS 16            // Directorios listados que se conservan para completar.
+#define COMPL_JOBS 64            // Números de trabajo que se ofrecen al completar.
+#define COMPL_LIST 100           // Candidatos que se muestran como máximo.
 #define TERM_PROMPT "SHELL > "
 #define C_BLACK     "\x1b[0m"
 #define C_RED       "\x1b[31;1;1m"
@@ -26,6 +51,7 @@
 #define C_INFO      C_BLUE
 #define C_ERROR     C_RED
 #define C_PROMPT    C_MANGENTA
+#define C_SUGGEST   "\x1b[2m"
 #define C_DEFAULT   C_BLACK
 
 // Comandos de terminal.
@@ -38,5 +64,17 @@
 #define CMDHIST  "historial"
 #define CMDTOUT  "time-out"
 #define CMDCHILD "children"
+#define CMDAFTER "after"
+#define CMDSET   "set"
+#define CMDPRIO  "prio"
+#define CMDTASK  "taskset"
+#define CMDCAPT  "capture"
+#define CMDOUT   "output"
+#define CMDTRUE  "true"
+#define CMDFALSE "false"
+#define CMDECHO  "echo"
+#define CMDPRINTF "printf"
+#define CMDSLEEP "sleep"
+#define CMDTEST  "test"
 
 #endif
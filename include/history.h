@@ -10,6 +10,24 @@
  * 
  * - No protegidas:
  * 
+ * Las entradas se guardan en un buffer circular de HIST_CAPACITY entradas, así
+ * que la entrada N se encuentra directamente y las más antiguas se descartan.
+ * El texto de cada entrada es una cadena interna, compartida por las entradas
+ * iguales; sólo la entrada que se edita tiene su propia copia. Si dedup está
+ * activo, al repetir un comando su entrada anterior se marca como borrada, sin
+ * renumerar las demás, y sólo queda la nueva. Sólo se borra si está en el
+ * buffer: las entradas del fichero que no se han cargado no se comparan, y las
+ * marcas no se guardan, así que en la siguiente sesión vuelven a estar todas.
+ * 
+ * El historial se guarda en el fichero HIST_FILE, al que sólo se añaden líneas,
+ * y en HIST_INDEX, que guarda la posición de cada entrada en el primero. Ambos
+ * se mapean en memoria al iniciar la shell y las entradas de sesiones anteriores
+ * sólo se copian a un nodo cuando el usuario llega a ellas.
+ * 
+ * Varias shells pueden compartir el fichero: cada una añade sus entradas con una
+ * única escritura en modo O_APPEND, sin cerrojos, y antes de cada prompt lee
+ * sólo lo que las demás hayan añadido desde la última vez.
+ * 
  * @file  history.h
  * @autor Víctor Manuel Ortiz Guardeño
  * @date  27/04/2017
@@ -19,29 +37,69 @@
 #define HISTORY_H
 
 #include <defs.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <trigram.h>
+#include <prefix_trie.h>
 
 typedef struct H_Node Node;
 typedef Node * HistoryLine;
+typedef struct H_String HistString;
+
+struct H_String {
+  HistString * next;                // Siguiente cadena de la misma cubeta.
+  uint32_t hash;
+  int refs;                         // Entradas que la usan.
+  int last;                         // Última entrada que la usó.
+  char text[];
+};
 
 struct H_Node {
-  char command[MAX_LINE_COMMAND];   // Comando de línea.
+  char * command;                   // Comando de línea (la cadena interna o la copia).
+  HistString * text;                // Cadena interna, o NULL en la entrada editable.
   char dirty;                       // 1 si la línea está sucia, 0 si no.
-  char * backup;                    // copia de seguridad de la línea limpia.
-  Node * prev;                      // Siguiente linea del historial.
-  Node * next;                      // Anterior línea del historial.
+  char * backup;                    // Copia que se edita de la línea limpia.
+  int num;                          // Número de la entrada en el historial.
 };
 
 struct S_History {
-  Node * first;                     // Primera línea del historial.
-  Node * last;                      // Última línea del historial.
+  Node * ring;                      // Buffer circular: la entrada N está en ring[(N-1) % capacity].
+  int capacity;
+  HistString ** buckets;            // Tabla de cadenas internas.
+  uint32_t mask;                    // Número de cubetas - 1.
+  Node editing;                     // Entrada que se está escribiendo.
+  char line[MAX_LINE_COMMAND];      // Texto de la entrada que se está escribiendo.
+  char editing_on;                  // 1 si hay entrada editable.
   HistoryLine selected;             // Entrada seleccionada.
-  int total;
+  int total;                        // Entradas del historial (sin la editable).
+  int dedup;                        // 1 si al repetir un comando se mueve su entrada al final.
+  int stored;                       // Entradas de sesiones anteriores (en el fichero).
+  int fd;                           // Fichero del historial, o -1 si no se guarda.
+  const char * data;                // Fichero del historial mapeado.
+  size_t size;                      // Tamaño mapeado del fichero.
+  const uint64_t * index;           // Índice mapeado: posición de cada entrada.
+  off_t seen;                       // Posición del fichero hasta la que se ha leído.
+  off_t own;                        // Posición de la última entrada propia, o -1.
+  Node scratch;                     // Nodo para consultar entradas fuera del buffer.
+  char scratch_line[MAX_LINE_COMMAND];
+  TrigramIndex recent;              // Trigramas de las entradas añadidas en esta sesión.
+  TrigramIndex past;                // Trigramas de las entradas del fichero.
+  int past_from;                    // Entrada más antigua indexada en past, o 0 si no se ha empezado.
+  PrefixTrie recent_prefixes;       // Prefijos de las entradas añadidas en esta sesión.
+  PrefixTrie past_prefixes;         // Prefijos de las entradas del fichero.
+  int past_prefixes_from;           // Entrada más antigua del árbol del fichero, o 0.
+  Node ** touched;                  // Entradas editadas en este prompt.
+  char ** overlays;                 // Copias para editar, que se reutilizan en cada prompt.
+  int ntouched;                     // Entradas editadas (y copias en uso).
+  int noverlays;                    // Copias reservadas.
 };
 
 typedef struct S_History History;
 
 /**
- * Inicia el historial para su posterior utilización.
+ * Inicia el historial para su posterior utilización. Mapea el fichero del
+ * historial y su índice, y añade al índice las entradas que le falten.
  * 
  * @param hist  Dirección del historial.
  */
@@ -56,7 +114,8 @@ void initHist(History * hist);
 void destroyHist(History * hist);
 
 /**
- * Añade un comando al final del historial.
+ * Añade un comando al final del historial. Si dedup está activo, la entrada
+ * anterior con el mismo comando se borra si está en el buffer.
  * 
  * @param hist   Dirección del historial
  * @param cmd    Comando a añadir.
@@ -65,7 +124,7 @@ void destroyHist(History * hist);
 void append(History * hist, char * cmd);
 
 /**
- * Elimina la última entrada del historial.
+ * Elimina la última entrada del historial: la editable, si la hay.
  * 
  * @param hist   Dirección del historial.
  */
@@ -76,7 +135,8 @@ void removeLast(History * hist);
  * Permite acceder a la primera entrada del historial.
  * 
  * @param hist   Dirección del historial.
- * @return       Primera entrada al historial, o NULL si no existiera.
+ * @return       Primera entrada al historial que sigue en el buffer, o NULL si no
+ *               existiera.
  */
 
 Node * getFirstCommand(History * hist);
@@ -93,7 +153,9 @@ Node * getLastCommand(History * hist);
 
 /**
  * Esta función permite acceder a una linea del historial por su número. Devolverá
- * NULL si no existe tal linea.
+ * NULL si no existe tal linea. Las entradas de sesiones anteriores que ya no
+ * están en el buffer se devuelven en un nodo auxiliar, válido hasta la
+ * siguiente llamada.
  * 
  * @param hist  Historial
  * @param n     Número de línea.
@@ -107,20 +169,23 @@ HistoryLine getLine(History * hist, int n);
  * Esta función está pensada para navegar por el historial. Esta puede ser NULL
  * si no hay siguiente.
  * 
+ * @param hist  Dirección del historial.
  * @param node  Entrada del historial.
  */
 
-void nextCommand(HistoryLine * node);
+void nextCommand(History * hist, HistoryLine * node);
 
 /**
  * Permite obtener la entrada previa a la pasada por argumento en el historial.
  * Esta función está pensada para navegar por el historial. Esta puede ser NULL
- * si no hay anterior.
+ * si no hay anterior, o si ya se descartó del buffer. Si la anterior es de una
+ * sesión previa, se carga.
  * 
+ * @param hist  Dirección del historial.
  * @param node  Entrada del historial.
  */
 
-void prevCommand(HistoryLine * node);
+void prevCommand(History * hist, HistoryLine * node);
 
 
 /**
@@ -143,7 +208,8 @@ char isEmptyEntry(HistoryLine line);
 char isUnprotectEntry(HistoryLine line);
 
 /**
- * Limpia todas las líneas sucias del historial.
+ * Limpia todas las líneas sucias del historial. Sólo se recorren las entradas
+ * editadas en este prompt.
  * 
  * @param hist  Dirección del historial.
  */
@@ -151,13 +217,16 @@ char isUnprotectEntry(HistoryLine line);
 void cleanHistory(History * hist);
 
 /**
- * Esta función convierte el nodo pasado como argumento en DIRTY.
+ * Esta función convierte el nodo pasado como argumento en DIRTY. La copia que
+ * se edita sale de las del historial, que se reservan una vez y se reutilizan
+ * en cada prompt.
  * 
+ * @param hist  Dirección del historial.
  * @param node  Dirección del nodo.
  * 
  */
 
-void dirtyNode(Node * node);
+void dirtyNode(History * hist, Node * node);
 
 /**
  * Restaura el valor de un nodo DIRTY.
@@ -176,12 +245,59 @@ void restoreNode(Node * node);
 void appendUnprotectEntry(History * hist); // crea un nodo editable
 
 /**
- * Esta función protege una línea DIRTY.
+ * Esta función protege la línea editable: la añade al final del historial.
+ * 
+ * @param hist Dirección del historial.
+ * @param line Dirección de la línea editable.
+ */
+
+void protectEntry(History * hist, HistoryLine line);
+
+/**
+ * Guarda una línea al final del fichero del historial, con una sola escritura.
+ * 
+ * @param hist  Dirección del historial.
+ * @param line  Línea a guardar.
+ */
+
+void saveEntry(History * hist, HistoryLine line);
+
+/**
+ * Añade al historial las entradas que otras shells han guardado en el fichero
+ * desde la última llamada. Sólo se lee la parte nueva del fichero.
+ * 
+ * @param hist  Dirección del historial.
+ */
+
+void syncHist(History * hist);
+
+/**
+ * Busca la entrada más reciente, anterior a una dada, que contiene un texto.
+ * Las entradas se buscan en los índices de trigramas. El del fichero se
+ * construye por tramos, de las entradas más recientes a las más antiguas, y
+ * sólo hasta encontrar la coincidencia; la siguiente búsqueda sigue por ahí.
+ * 
+ * @param hist    Dirección del historial.
+ * @param query   Texto a buscar.
+ * @param before  Se buscan las entradas con número menor que este.
+ * @return        Número de la entrada, o 0 si no hay ninguna.
+ */
+
+int searchHistory(History * hist, const char * query, int before);
+
+/**
+ * Busca la entrada anterior o siguiente a una dada que empieza por un prefijo.
+ * Las entradas se buscan en los árboles de prefijos. El del fichero se
+ * construye por tramos, como el de trigramas (ver searchHistory).
  * 
- * @param line Dirección de la línea DIRTY.
+ * @param hist    Dirección del historial.
+ * @param prefix  Prefijo (no vacío).
+ * @param from    Número de la entrada de la que se parte.
+ * @param dir     -1 para buscar hacia atrás, 1 hacia delante.
+ * @return        Número de la entrada, o 0 si no hay ninguna.
  */
 
-void protectEntry(HistoryLine line);
+int searchPrefix(History * hist, const char * prefix, int from, int dir);
 
 
 #endif /* HISTORY_H */
@@ -0,0 +1,122 @@
+/**
+ * Contiene la captura de la salida de los trabajos en background. Cada trabajo
+ * capturado escribe su stdout y su stderr en una tubería que un hilo de la shell
+ * vuelca en un buffer circular de tamaño fijo, mapeado dos veces seguidas en
+ * memoria para que las escrituras que dan la vuelta sean contiguas. Así la
+ * memoria está acotada, por mucho que escriba el trabajo, y la salida se
+ * muestra sólo cuando el usuario la pide.
+ * 
+ * También contiene el multiplexor de salidas: las tuberías de los trabajos en
+ * background se vigilan con epoll desde un único hilo, que escribe en la
+ * terminal líneas completas etiquetadas con el trabajo que las produjo.
+ * 
+ * @file  job_output.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef JOB_OUTPUT_H
+#define JOB_OUTPUT_H
+
+#include <defs.h>
+#include <pthread.h>
+
+struct S_OutputRing {
+    int id;                           // Número de la salida, para el comando output.
+    char * command;                   // Copia del comando que la produce.
+    char * base;                      // Buffer circular (mapeado dos veces).
+    unsigned long head;               // Total de bytes escritos.
+    int fd;                           // Extremo de lectura de la tubería.
+    char closed;                      // 1 cuando todos los procesos cerraron la tubería.
+    pthread_t tid;                    // Hilo que vacía la tubería.
+    pthread_mutex_t lock;
+    pthread_cond_t changed;           // Se avisa cada vez que llegan datos.
+    struct S_OutputRing * next;
+};
+
+typedef struct S_OutputRing OutputRing;
+typedef OutputRing * ListOutputs;
+
+/**
+ * Inicializa la lista de salidas capturadas.
+ * 
+ * @param list  Dirección de la lista.
+ */
+
+void init_outputs(ListOutputs * list);
+
+/**
+ * Crea una salida capturada y el hilo que la vacía. Si ya hay MAX_OUTPUTS, se
+ * descarta la más antigua que haya terminado.
+ * 
+ * @param list     Dirección de la lista de salidas.
+ * @param command  Comando del trabajo.
+ * @param wfd      Aquí se devuelve el extremo de escritura de la tubería, que
+ *                 el padre debe cerrar tras lanzar los procesos.
+ * @return         La salida creada, o NULL si hubo algún error.
+ */
+
+OutputRing * create_output(ListOutputs * list, const char * command, int * wfd);
+
+/**
+ * Busca una salida por su número.
+ * 
+ * @param list  Lista de salidas.
+ * @param id    Número de la salida.
+ * @return      La salida, o NULL si no existe.
+ */
+
+OutputRing * search_output(ListOutputs list, int id);
+
+/**
+ * Escribe en fd lo que haya en el buffer desde la posición from (en bytes
+ * totales escritos). Si esos bytes ya se sobreescribieron, empieza por el más
+ * antiguo que se conserve.
+ * 
+ * @param out   Salida capturada.
+ * @param from  Posición desde la que escribir.
+ * @param fd    Descriptor destino.
+ * @return      Posición hasta la que se ha escrito.
+ */
+
+unsigned long write_output(OutputRing * out, unsigned long from, int fd);
+
+/**
+ * Lee, con el cerrojo de la salida, lo que lleva escrito y si ya se cerró.
+ * 
+ * @param out   Salida capturada.
+ * @param head  Aquí se deja el total de bytes escritos.
+ * @return      1 si todos los procesos cerraron la tubería, 0 si no.
+ */
+
+char output_status(OutputRing * out, unsigned long * head);
+
+/**
+ * Espera a que lleguen datos nuevos a partir de la posición from, o a que se
+ * cierre la salida, como mucho timeout_ms milisegundos.
+ * 
+ * @return  1 si hay datos nuevos o se cerró la salida, 0 si no.
+ */
+
+char wait_output(OutputRing * out, unsigned long from, int timeout_ms);
+
+/**
+ * Libera todas las salidas capturadas.
+ * 
+ * @param list  Dirección de la lista.
+ */
+
+void destroy_outputs(ListOutputs * list);
+
+/**
+ * Crea una tubería cuyas líneas se escriben en la salida estándar de la shell
+ * precedidas de la etiqueta. El multiplexor se arranca la primera vez.
+ * 
+ * @param tag  Etiqueta de las líneas.
+ * @return     Extremo de escritura de la tubería, que el padre debe cerrar
+ *             tras lanzar los procesos, o -1 si hubo algún error.
+ */
+
+int mux_attach(const char * tag);
+
+#endif /* JOB_OUTPUT_H */
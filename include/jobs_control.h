@@ -12,28 +12,37 @@
 #define JOBS_CONTROL_H
 
 #include <defs.h>
+#include <parser.h>
 #include <unistd.h>
 #include <termios.h>
+#include <stdio.h>
+#include <pthread.h>
 
-typedef enum {READY,RUNNING,STOPPED,SIGNALED,COMPLETED} State;
+typedef enum {READY,RUNNING,STOPPED,SIGNALED,COMPLETED,WAITING,CANCELLED,QUEUED} State;
 
 struct T_Process {
     char * args[MAX_ARGS + 1];       // +1, por el NULL que indica el fin de la lista.
     int argc;                        // Número de argumentos.
+    char * outfile;                  // Fichero al que se redirige la salida, o NULL.
     pid_t pid;                       // PID del proceso.
     State state;
     int info;
     int num_job;
+    FILE * out;                      // Salida de los comandos internos.
+    pthread_t thread;                // Hilo que ejecuta la etapa, si es un comando interno.
+    char threaded;                   // 1 si la etapa está en un hilo al que aún no se ha esperado.
+    volatile char interrupted;       // 1 para que la etapa interna termine cuanto antes (sleep).
     struct T_Process * next;         // Siguiente proceso.
 };
 
 typedef struct T_Process Process;
 
 typedef enum {NORMAL_JOB,RR_JOB} TypeJob;
-#define IS_JOB_ENDED(s) ((s) == COMPLETED || (s) == SIGNALED)
+#define IS_JOB_ENDED(s) ((s) == COMPLETED || (s) == SIGNALED || (s) == CANCELLED)
 
 struct T_Job {
     const char * command;             // Comando que inició el trabajo.
+    char * argbuf;                    // Argumentos de todos sus procesos, seguidos.
     struct termios tmodes;            // Modo de la terminal.
     char cargarModo;                  // Indica si se tiene que cargar el modo de la terminal al iniciar de nuevo.
     pid_t gpid;                       // pid del grupo de trabajo.
@@ -47,6 +56,14 @@ struct T_Job {
     char respawnable;
     Process * proc;                   // Lista de procesos del trabajo.
     int time_out;                     // Indica si tiene time out asignado.
+    struct T_Job * deps[MAX_DEPS];    // Trabajos que deben terminar bien antes de lanzarlo.
+    int ndeps;                        // Número de dependencias pendientes.
+    unsigned long ticket;             // Orden de llegada a la cola de trabajos (QUEUED).
+    int throttled;                    // Si la shell lo detuvo por presión de memoria, orden en que lo hizo (desde 1); si no, 0.
+    int priority;                     // Prioridad en background (BgPriority), o -1 para usar la global.
+    struct CpuMask * cpus;            // CPUs en las que se ejecuta (taskset), o NULL.
+    char capture;                     // 1 si su salida se captura aunque capture esté desactivado.
+    struct S_OutputRing * output;     // Salida capturada, o NULL.
     struct T_Job * next;              // Siguiente trabajo.
 };
 
@@ -73,7 +90,7 @@ void destroy_list_jobs(ListJobs * list_jobs);
 /**
  * Crea un trabajo a partir del comando dado como argumento. Si este comando
  * tiene tuberías, creará varios enlazados. Si el comando tiene un &, tomará como
- * que estará en background. Si hubiera algo después del &, se ignorará.
+ * que estará en background (y con un +, además respawnable), esté donde esté.
  * 
  * Este trabajo se añadirá al final de todos los trabajos de la lista pasada como
  * argumento.
@@ -84,7 +101,7 @@ void destroy_list_jobs(ListJobs * list_jobs);
  * 
  * Por defecto, un trabajo se crea con las siguientes opciones:
  * 
- * - command    :    (Pasado como argumento)
+ * - command    :    (Copia del pasado como argumento)
  * - gpid       :    0
  * - termios    :    (Nada)
  * - cargarModo :    0
@@ -101,6 +118,19 @@ void destroy_list_jobs(ListJobs * list_jobs);
  */
 
 Job * create_job(ListJobs * list_jobs, const char * cmd);
+
+/**
+ * Igual que create_job, pero a partir de la línea ya analizada. Sus palabras
+ * son vistas de cmd que se copian en el trabajo, salvo si cl->borrowed: en ese
+ * caso el trabajo apunta a ellas, que deben durar más que él.
+ * 
+ * @param list_jobs  Dirección de la lista de trabajos.
+ * @param cmd        Comando que iniciará el trabajo.
+ * @param cl         Comando analizado.
+ * @return           NULL si list_jobs o cmd es nulo; el trabajo creado, en otro caso.
+ */
+
+Job * create_parsed_job(ListJobs * list_jobs, const char * cmd, const CommandLine * cl);
 void dup_job_command(Job * job);
 
 /**
@@ -127,8 +157,105 @@ char is_job_n_completed(Job * job, int i, char * signaled);
 
 void mark_process(Job * job, int status, pid_t pid);
 Job * search_job_by_process(ListJobs jobs,pid_t pid);
+Job * search_job_by_proc(ListJobs jobs, Process * proc);
 void analyce_job_status(Job * job);
 void kill_job(Job * job, int n, int sig);
 
+/**
+ * Pide a las etapas internas del trabajo que terminen cuanto antes. Se puede
+ * llamar desde un manejador de señal.
+ * 
+ * @param job  Trabajo.
+ */
+
+void interrupt_stages(Job * job);
+
+/**
+ * Espera a que terminen los hilos de las etapas internas del trabajo.
+ * 
+ * @param job  Trabajo.
+ */
+
+void join_stages(Job * job);
+
+/**
+ * Elimina de la lista el trabajo pasado como argumento. A diferencia de
+ * remove_job, no depende del gpid, por lo que sirve para trabajos que nunca
+ * llegaron a lanzarse (esperando dependencias).
+ * 
+ * @param list_jobs  Dirección de la lista de trabajos.
+ * @param job        Trabajo a eliminar.
+ */
+
+void remove_job_ref(ListJobs * list_jobs, Job * job);
+
+/**
+ * Añade una dependencia al trabajo: no se lanzará hasta que dep termine con
+ * éxito.
+ * 
+ * @param job  Trabajo que espera.
+ * @param dep  Trabajo del que depende.
+ * @return     1 si se añadió, 0 si se superó MAX_DEPS.
+ */
+
+char add_job_dependency(Job * job, Job * dep);
+
+/**
+ * Informa a los trabajos en espera de que done ha terminado. Si terminó con
+ * éxito, se elimina de sus dependencias; si no, los trabajos que dependían de él
+ * pasan a CANCELLED, y con ellos, en cascada, todos los que dependían de estos.
+ * 
+ * @param jobs  Lista de trabajos.
+ * @param done  Trabajo terminado.
+ */
+
+void resolve_job_dependency(ListJobs jobs, Job * done);
+
+/**
+ * Busca el primer trabajo en espera que ya no tiene dependencias pendientes.
+ * 
+ * @param jobs  Lista de trabajos.
+ * @return      El trabajo listo, o NULL si no hay ninguno.
+ */
+
+Job * next_ready_job(ListJobs jobs);
+
+/**
+ * Cuenta los trabajos en background que ocupan un hueco de ejecución, esto es,
+ * los que se han lanzado y aún no han terminado.
+ * 
+ * @param jobs  Lista de trabajos.
+ * @return      Número de trabajos en background lanzados.
+ */
+
+int count_background_jobs(ListJobs jobs);
+
+/**
+ * Pone el trabajo en la cola (estado QUEUED) a la espera de un hueco libre.
+ * 
+ * @param job  Trabajo a encolar.
+ */
+
+void enqueue_job(Job * job);
+
+/**
+ * Devuelve el trabajo que más tiempo lleva en la cola.
+ * 
+ * @param jobs  Lista de trabajos.
+ * @return      El primer trabajo de la cola, o NULL si está vacía.
+ */
+
+Job * next_queued_job(ListJobs jobs);
+
+/**
+ * Calcula la posición de un trabajo encolado dentro de la cola.
+ * 
+ * @param jobs  Lista de trabajos.
+ * @param job   Trabajo encolado.
+ * @return      Posición en la cola, empezando en 1.
+ */
+
+int queue_position(ListJobs jobs, Job * job);
+
 #endif /* JOBS_CONTROL_H */
 
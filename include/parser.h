@@ -0,0 +1,71 @@
+/**
+ * Contiene el analizador de la línea de comandos. En una sola pasada se
+ * reconocen las etapas de la tubería, sus argumentos, la redirección de la
+ * salida y las marcas de background (&) y respawnable (+), y se expanden las
+ * referencias al historial (historial N). Los argumentos no se copian: son
+ * vistas de la línea (o de la entrada del historial expandida), que se copian
+ * sólo al crear el trabajo.
+ *
+ * @file  parser.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <defs.h>
+
+// Vista de una palabra: no acaba en '\0'.
+typedef struct {
+    const char * str;
+    int len;
+} Token;
+
+// Etapa de una tubería.
+typedef struct {
+    Token args[MAX_ARGS];
+    int argc;
+    Token outfile;                  // Fichero de la redirección '>', o len 0 si no hay.
+} Stage;
+
+// Línea analizada.
+typedef struct {
+    Stage stages[MAX_STAGES];
+    int nstages;                    // Siempre hay al menos una etapa, aunque esté vacía.
+    char background;                // 1 si había un &.
+    char respawnable;               // 1 si había un +.
+    char expanded;                  // 1 si se expandió alguna referencia al historial.
+    char overflow;                  // 1 si se descartaron argumentos o etapas.
+    char borrowed;                  // 1 si las palabras acaban en '\0' y duran más que los trabajos.
+    int size;                       // Bytes para copiar todas las palabras con su '\0'.
+} CommandLine;
+
+// Devuelve el texto de la entrada n del historial, o NULL si no existe.
+typedef const char * (*HistoryLookup)(int n, void * ctx);
+
+/**
+ * Analiza una línea. Las vistas apuntan a la línea y a los textos devueltos por
+ * lookup, así que sólo son válidas mientras éstos no cambien.
+ *
+ * @param line    Línea.
+ * @param cl      Aquí se deja el resultado.
+ * @param lookup  Función para expandir "historial N", o NULL para no expandir.
+ * @param ctx     Argumento de lookup.
+ */
+
+void parse_line(const char * line, CommandLine * cl, HistoryLookup lookup, void * ctx);
+
+/**
+ * Escribe la línea analizada en forma normalizada: palabras separadas por un
+ * espacio, " | " entre etapas, " > fichero" y la marca de background al final.
+ *
+ * @param cl      Línea analizada.
+ * @param buff    Buffer destino.
+ * @param size    Tamaño del buffer.
+ * @return        0, o -1 si no cabe.
+ */
+
+int unparse_line(const CommandLine * cl, char * buff, int size);
+
+#endif /* PARSER_H */
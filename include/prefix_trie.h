@@ -0,0 +1,83 @@
+/**
+ * Contiene el árbol de prefijos del historial. Cada nodo corresponde a un
+ * prefijo y guarda, en orden creciente, los números de las entradas que
+ * empiezan por él. Sólo se indexan los HIST_PREFIX_DEPTH primeros caracteres;
+ * con prefijos más largos hay que comprobar el texto de las entradas. Cada nodo
+ * guarda como mucho las HIST_PREFIX_POSTINGS entradas más recientes: las
+ * anteriores hay que buscarlas recorriendo el historial.
+ * 
+ * @file  prefix_trie.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef PREFIX_TRIE_H
+#define PREFIX_TRIE_H
+
+typedef struct S_TrieNode TrieNode;
+
+struct S_TrieNode {
+  char c;                           // Carácter del nodo.
+  TrieNode * child;                 // Primer hijo.
+  TrieNode * sibling;               // Siguiente hermano.
+  int count;                        // Entradas en la lista.
+  int size;                         // Capacidad de la lista.
+  int * nums;                       // Números de entrada, en orden creciente.
+  char truncated;                   // 1 si se descartaron entradas anteriores a nums[0].
+};
+
+typedef TrieNode PrefixTrie;
+
+/**
+ * Inicia un árbol vacío.
+ * 
+ * @param trie  Dirección del árbol.
+ */
+
+void initTrie(PrefixTrie * trie);
+
+/**
+ * Añade una entrada a los nodos de sus prefijos. Los números deben llegar en
+ * orden creciente; si llega uno menor que el último de una lista, se descartan
+ * los mayores (las entradas se eliminaron y sus números se reutilizan). Si la
+ * lista está llena, se descarta la más antigua.
+ * 
+ * @param trie  Dirección del árbol.
+ * @param n     Número de la entrada.
+ * @param text  Texto de la entrada.
+ * @param len   Longitud del texto.
+ */
+
+void addPrefixes(PrefixTrie * trie, int n, const char * text, int len);
+
+/**
+ * Añade al árbol los nodos de otro cuyas entradas son todas anteriores a las
+ * suyas, y libera el otro. Cada nodo se completa con las más recientes del
+ * otro hasta HIST_PREFIX_POSTINGS; si no caben todas, queda truncado.
+ * 
+ * @param trie   Dirección del árbol.
+ * @param older  Árbol de las entradas anteriores.
+ */
+
+void mergePrefixes(PrefixTrie * trie, PrefixTrie * older);
+
+/**
+ * Busca el nodo de un prefijo (de sus HIST_PREFIX_DEPTH primeros caracteres).
+ * 
+ * @param trie    Dirección del árbol.
+ * @param prefix  Prefijo.
+ * @param len     Longitud del prefijo (mayor que 0).
+ * @return        El nodo, o NULL si no hay entradas con el prefijo (ni descartadas).
+ */
+
+const TrieNode * findPrefix(PrefixTrie * trie, const char * prefix, int len);
+
+/**
+ * Libera el árbol.
+ * 
+ * @param trie  Dirección del árbol.
+ */
+
+void destroyTrie(PrefixTrie * trie);
+
+#endif /* PREFIX_TRIE_H */
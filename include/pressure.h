@@ -0,0 +1,27 @@
+/**
+ * Contiene la lectura de la presión del sistema (PSI), usada para decidir si
+ * se pueden lanzar más trabajos en background sin perjudicar al de foreground.
+ * 
+ * @file  pressure.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+typedef enum {PRESSURE_CPU, PRESSURE_MEMORY} Resource;
+
+/**
+ * Lee la presión media de los últimos 10 segundos de un recurso, esto es, el
+ * porcentaje de tiempo en el que alguna tarea estuvo esperando por él (línea
+ * "some" de /proc/pressure). Si el kernel no tiene PSI, para la CPU se usa la
+ * carga media del último minuto repartida entre las CPUs.
+ * 
+ * @param res  Recurso a consultar.
+ * @return     Presión en tanto por ciento, o -1 si no se pudo obtener.
+ */
+
+double read_pressure(Resource res);
+
+#endif /* PRESSURE_H */
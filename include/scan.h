@@ -0,0 +1,39 @@
+/**
+ * Contiene la búsqueda de delimitadores usada por el analizador de la línea de
+ * comandos. Se comparan 16 (SSE2) o 32 (AVX2) bytes a la vez con los
+ * caracteres buscados; la versión se elige al ejecutar según lo que soporte la
+ * CPU, y si no tiene ninguna de las dos se recorre carácter a carácter.
+ * 
+ * @file  scan.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#define SCAN_SET_MAX 8                  // Caracteres que se pueden buscar a la vez.
+
+typedef enum {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2} ScanLevel;
+
+/**
+ * Busca el primer carácter de la cadena que esté en set, o el '\0' final.
+ * 
+ * @param p     Cadena.
+ * @param set   Caracteres buscados (como mucho SCAN_SET_MAX).
+ * @return      Posición del carácter encontrado, o del '\0' final.
+ */
+
+const char * scan_any(const char * p, const char * set);
+
+/**
+ * Elige la versión de scan_any. Si la CPU no soporta la pedida, se usa la
+ * mejor de las inferiores. Si no se llama, se elige la mejor en el primer uso.
+ * 
+ * @param level  Versión pedida.
+ * @return       Versión que se usará.
+ */
+
+ScanLevel scan_select(ScanLevel level);
+
+#endif /* SCAN_H */
@@ -0,0 +1,97 @@
+/**
+ * Contiene las políticas de planificación que la shell aplica a los trabajos:
+ * la prioridad de los trabajos en background, para que no compitan con el de
+ * foreground, y la afinidad de CPU de cada proceso.
+ * 
+ * @file  sched_policy.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef SCHED_POLICY_H
+#define SCHED_POLICY_H
+
+#include <unistd.h>
+
+// Prioridad de los trabajos en background.
+// - BG_NORMAL : la misma que la shell.
+// - BG_NICE   : nice BG_NICE_VALUE y prioridad de E/S best-effort mínima.
+// - BG_BATCH  : como BG_NICE, pero con SCHED_BATCH.
+// - BG_IDLE   : SCHED_IDLE y clase de E/S idle; sólo usa la CPU y el disco libres.
+typedef enum {BG_NORMAL, BG_NICE, BG_BATCH, BG_IDLE} BgPriority;
+
+#define BG_PRIORITY_NAMES {"normal", "nice", "batch", "idle", NULL}
+
+/**
+ * Baja la prioridad de un proceso según la política dada.
+ * 
+ * @param pid   Proceso, o 0 para el proceso actual.
+ * @param prio  Política a aplicar.
+ */
+
+void lower_priority(pid_t pid, BgPriority prio);
+
+/**
+ * Devuelve un proceso a la prioridad normal (SCHED_OTHER, nice 0 y E/S según
+ * su nice). Sin CAP_SYS_NICE, el nice sólo baja hasta donde permite
+ * RLIMIT_NICE (y sin él no se sale de SCHED_IDLE); esto no se considera error.
+ * 
+ * @param pid  Proceso, o 0 para el proceso actual.
+ * @return     0 si se restauró (hasta donde se permite), -1 si hubo otro error.
+ */
+
+int restore_priority(pid_t pid);
+
+// Reparto automático de los procesos de un trabajo entre las CPUs.
+// - AFFINITY_NONE    : no se fija la afinidad.
+// - AFFINITY_COMPACT : procesos consecutivos en hilos hermanos del mismo núcleo,
+//                      para que las etapas de una tubería compartan caché.
+// - AFFINITY_SPREAD  : cada proceso en un núcleo físico distinto (réplicas rr).
+typedef enum {AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SPREAD} AffinityPolicy;
+
+#define AFFINITY_NAMES {"none", "compact", "spread", NULL}
+
+typedef struct CpuMask CpuMask;
+
+/**
+ * Crea una máscara de CPUs a partir de una lista del estilo "0-3,6".
+ * 
+ * @param list  Lista de CPUs.
+ * @return      Máscara reservada con malloc, o NULL si la lista no es válida.
+ */
+
+CpuMask * parse_cpu_list(const char * list);
+
+/**
+ * Crea una máscara de CPUs a partir de una máscara en hexadecimal, como la de
+ * taskset sin -c: "3" (o "0x3") son las CPUs 0 y 1.
+ * 
+ * @param hex  Máscara en hexadecimal, con o sin el prefijo 0x.
+ * @return     Máscara reservada con malloc, o NULL si no es válida o está vacía.
+ */
+
+CpuMask * parse_cpu_hex(const char * hex);
+
+/**
+ * Calcula la CPU que le corresponde a un proceso según la política. Las CPUs se
+ * toman de la afinidad de la propia shell, agrupadas según la topología de
+ * /sys/devices/system/cpu.
+ * 
+ * @param policy  Política de reparto.
+ * @param unit    Posición del proceso en el reparto (se toma módulo el número de CPUs).
+ * @return        Máscara con una sola CPU (válida hasta la siguiente llamada), o
+ *                NULL si la política es AFFINITY_NONE.
+ */
+
+CpuMask * policy_mask(AffinityPolicy policy, int unit);
+
+/**
+ * Fija la afinidad del proceso actual.
+ * 
+ * @param mask  Máscara de CPUs.
+ * @return      0 si se aplicó, -1 si hubo algún error.
+ */
+
+int apply_affinity(CpuMask * mask);
+
+#endif /* SCHED_POLICY_H */
@@ -0,0 +1,60 @@
+/**
+ * Contiene la ejecución de ficheros de comandos. La primera vez que se ejecuta
+ * un fichero se analiza entero y su forma analizada se guarda junto a él (con
+ * la extensión .shc); las siguientes veces se mapea esa caché y los comandos
+ * se leen de ella sin volver a analizar ni copiar las palabras. La caché se
+ * descarta si cambian el tamaño del fichero o su contenido (si sólo cambia la
+ * fecha de modificación, se comprueba el hash del contenido).
+ * 
+ * @file  script.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <parser.h>
+#include <stddef.h>
+
+typedef struct {
+    char * data;                    // Caché mapeada, o recién generada en memoria.
+    size_t length;                  // Tamaño de data.
+    char mapped;                    // 1 si data viene de mmap.
+    const char * next;              // Siguiente comando.
+    unsigned int left;              // Comandos que quedan.
+} Script;
+
+/**
+ * Abre un fichero de comandos, desde su caché si es válida. Si no, lo analiza
+ * y trata de guardar la caché (si no se puede, se sigue sin ella).
+ * 
+ * @param path    Ruta del fichero.
+ * @param sc      Script a inicializar.
+ * @return        0, o -1 si no se pudo leer el fichero (ver errno).
+ */
+
+int open_script(const char * path, Script * sc);
+
+/**
+ * Lee el siguiente comando. Las palabras se prestan (cl->borrowed): apuntan a
+ * la caché, que sigue siendo válida hasta close_script.
+ * 
+ * @param sc      Script.
+ * @param cmd     Aquí se deja el texto del comando.
+ * @param cl      Aquí se deja el comando analizado.
+ * @return        1 si se leyó, 0 al final, o -1 si la caché está dañada.
+ */
+
+int next_script_line(Script * sc, const char ** cmd, CommandLine * cl);
+
+/**
+ * Libera la caché. Los trabajos creados con sus palabras deben haberse
+ * destruido antes.
+ * 
+ * @param sc      Script.
+ */
+
+void close_script(Script * sc);
+
+#endif /* SCRIPT_H */
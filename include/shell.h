@@ -16,14 +16,31 @@
 #include <IOModule.h>
 #include <defs.h>
 #include <jobs_control.h>
+#include <sched_policy.h>
+#include <job_output.h>
+#include <completion.h>
+#include <script.h>
+#include <builtins.h>
 
 struct T_Shell {
   int fdin;
   pid_t pid;
+  char job_control;                 // 0 al ejecutar un fichero: sin terminal ni grupos de procesos.
   History hist;
   ListJobs jobs;
   char sigalarm_on;
   struct termios mode;
+  int max_bg_jobs;                  // Máximo de trabajos en background (0, sin límite).
+  int pressure_cpu;                 // Presión de CPU (%) a partir de la que se retienen trabajos.
+  int pressure_mem;                 // Presión de memoria (%) a partir de la que se retienen trabajos.
+  int pressure_stop;                // 1 si se detienen trabajos con presión de memoria sostenida.
+  int mem_high;                     // Segundos seguidos con presión de memoria alta.
+  int bg_priority;                  // Prioridad por defecto de los trabajos en background (BgPriority).
+  int affinity;                     // Reparto de los procesos entre las CPUs (AffinityPolicy).
+  int affinity_unit;                // Siguiente posición del reparto; sigue de un trabajo a otro.
+  int capture;                      // 1 si se captura la salida de los trabajos en background.
+  int mux;                          // 1 si la salida de los trabajos en background se multiplexa.
+  ListOutputs outputs;              // Salidas capturadas.
 } shell;
 
 typedef struct T_Shell Shell;
@@ -49,7 +66,7 @@ typedef struct {
 } InternalCommandInfo;
 
 // Configuración del nómbre del comando, y su cadena asociada.
-// CMD(enum_name, str_name, 1 if forked)
+// CMD(enum_name, str_name, 1 if forked, 2 if forked only in pipelines, background or redirections)
 #define INTERNAL_COMMAND  \
    CMD(cmd_exit,    CMDEXIT,   0) \
    CMD(cmd_fg,      CMDFG,     0) \
@@ -59,7 +76,19 @@ typedef struct {
    CMD(cmd_rr,      CMDRR,     0) \
    CMD(cmd_hist,    CMDHIST,   1) \
    CMD(cmd_timeout, CMDTOUT,   0) \
-   CMD(cmd_children, CMDCHILD, 1)
+   CMD(cmd_children, CMDCHILD, 1) \
+   CMD(cmd_after,   CMDAFTER,  0) \
+   CMD(cmd_set,     CMDSET,    0) \
+   CMD(cmd_prio,    CMDPRIO,   0) \
+   CMD(cmd_taskset, CMDTASK,   0) \
+   CMD(cmd_capture, CMDCAPT,   0) \
+   CMD(cmd_output,  CMDOUT,    0) \
+   CMD(cmd_true,    CMDTRUE,   2) \
+   CMD(cmd_false,   CMDFALSE,  2) \
+   CMD(cmd_echo,    CMDECHO,   2) \
+   CMD(cmd_printf,  CMDPRINTF, 2) \
+   CMD(cmd_sleep,   CMDSLEEP,  2) \
+   CMD(cmd_test,    CMDTEST,   2)
 
 // Creación de la enumeración
 enum internal_command_names {
@@ -97,6 +126,7 @@ InternalCommandInfo internalCommands = {
 
 #define LINK_CMD(c,f)   internalCommands.handler[(c)] = (f)
 #define ICMD_FORK(c)    internalCommands.fork[(c)]
+#define ICMD_INLINE(c)  (internalCommands.fork[(c)] == 2)
 #define ICMD_HANDLER(c) internalCommands.handler[(c)]
 #define ICMD_STR(c)     internalCommands.str_cmd[(c)]
 #define ICMD_TOTAL      internalCommands.count
@@ -104,5 +134,12 @@ InternalCommandInfo internalCommands = {
 #undef CAT_NOEXPAND
 #undef CAT
 
+// Opciones de la shell, configurables con el comando set.
+typedef struct {
+    const char * name;
+    int * value;
+    const char ** values;             // Nombres de los valores, o NULL si es numérica.
+} ShellOption;
+
 #endif /* SHELL_H */
 
@@ -0,0 +1,86 @@
+/**
+ * Contiene el índice de trigramas del historial. Para cada secuencia de tres
+ * caracteres guarda, en orden creciente, los números de las entradas que la
+ * contienen; una subcadena sólo puede estar en las entradas que tienen todos
+ * sus trigramas.
+ * 
+ * @file  trigram.h
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t key;                     // Trigrama, o 0 si la posición está libre.
+  int count;                        // Entradas en la lista.
+  int size;                         // Capacidad de la lista.
+  int * nums;                       // Números de entrada, en orden creciente.
+} Posting;
+
+typedef struct {
+  Posting * table;                  // Tabla hash con direccionamiento abierto.
+  uint32_t mask;                    // Tamaño de la tabla - 1.
+  uint32_t used;                    // Trigramas distintos.
+} TrigramIndex;
+
+/**
+ * Inicia un índice vacío.
+ * 
+ * @param idx  Dirección del índice.
+ */
+
+void initTrigrams(TrigramIndex * idx);
+
+/**
+ * Añade al índice los trigramas de una entrada. Los números deben llegar en
+ * orden creciente; si llega uno menor que el último de una lista, se descartan
+ * los mayores (las entradas se eliminaron y sus números se reutilizan).
+ * 
+ * @param idx   Dirección del índice.
+ * @param n     Número de la entrada.
+ * @param text  Texto de la entrada.
+ * @param len   Longitud del texto.
+ */
+
+void addTrigrams(TrigramIndex * idx, int n, const char * text, int len);
+
+/**
+ * Añade al índice las listas de otro cuyas entradas son todas anteriores a las
+ * suyas, y libera el otro. Permite indexar por tramos, de las entradas más
+ * recientes a las más antiguas.
+ * 
+ * @param idx    Dirección del índice.
+ * @param older  Índice de las entradas anteriores.
+ */
+
+void mergeTrigrams(TrigramIndex * idx, TrigramIndex * older);
+
+/**
+ * Busca la lista de entradas de un trigrama.
+ * 
+ * @param idx  Dirección del índice.
+ * @param tri  Los tres caracteres del trigrama.
+ * @return     La lista, o NULL si ninguna entrada lo contiene.
+ */
+
+const Posting * findTrigram(TrigramIndex * idx, const char * tri);
+
+/**
+ * Indica si una lista contiene una entrada (búsqueda binaria).
+ */
+
+char postingHas(const Posting * list, int n);
+
+/**
+ * Libera el índice.
+ * 
+ * @param idx  Dirección del índice.
+ */
+
+void destroyTrigrams(TrigramIndex * idx);
+
+#endif /* TRIGRAM_H */
@@ -0,0 +1,354 @@
+/**
+ * Implementación de las utilidades internas.
+ * 
+ * @file  builtins.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <builtins.h>
+#include <IOModule.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TEST_ERROR -1
+#define SLEEP_SLICE 100000000L          // Cada cuánto (ns) mira sleep si se ha interrumpido.
+
+void cmd_true_handler(Process * p) {
+    p->info = 0;
+}
+
+void cmd_false_handler(Process * p) {
+    p->info = 1;
+}
+
+void cmd_echo_handler(Process * p) {
+    char newline = 1;
+    int i = 1;
+    
+    if (p->argc > 1 && strcmp(p->args[1], "-n") == 0) {
+        newline = 0;
+        i++;
+    }
+    
+    for (; i < p->argc ; i++) {
+        fputs(p->args[i], p->out);
+        
+        if (i < p->argc - 1)
+            fputc(' ', p->out);
+    }
+    
+    if (newline)
+        fputc('\n', p->out);
+    
+    p->info = 0;
+}
+
+/**
+ * Escribe el carácter de un escape de printf.
+ * 
+ * @param out Salida.
+ * @param s   Posición tras la barra; se avanza hasta después del escape.
+ */
+
+static void put_escape(FILE * out, const char ** s) {
+    
+    switch (**s) {
+        case 'n':  fputc('\n', out); break;
+        case 't':  fputc('\t', out); break;
+        case 'r':  fputc('\r', out); break;
+        case 'a':  fputc('\a', out); break;
+        case 'b':  fputc('\b', out); break;
+        case 'f':  fputc('\f', out); break;
+        case 'v':  fputc('\v', out); break;
+        case '\\': fputc('\\', out); break;
+        
+        case '\0': // Barra al final del formato.
+            fputc('\\', out);
+            return;
+            
+        default:
+            fputc('\\', out);
+            fputc(**s, out);
+    }
+    
+    (*s)++;
+}
+
+/**
+ * Escribe un argumento con una conversión de printf.
+ * 
+ * @param out   Salida.
+ * @param spec  Conversión sin la letra final: %, opciones, anchura y precisión.
+ * @param conv  Letra de la conversión.
+ * @param arg   Argumento, o NULL si ya no quedan (se toma "" o 0).
+ * @return      0, o -1 si el argumento no es un número válido.
+ */
+
+static int put_conversion(FILE * out, char * spec, char conv, const char * arg) {
+    int len = strlen(spec);
+    char * end = NULL;
+    
+    if (arg == NULL)
+        arg = "";
+    
+    errno = 0;
+    
+    switch (conv) {
+        
+        case 's':
+            spec[len] = 's';
+            spec[len + 1] = '\0';
+            fprintf(out, spec, arg);
+            return 0;
+            
+        case 'c':
+            
+            if (*arg) {
+                spec[len] = 'c';
+                spec[len + 1] = '\0';
+                fprintf(out, spec, *arg);
+            }
+            
+            return 0;
+            
+        case 'd': case 'i':
+            sprintf(spec + len, "ll%c", conv);
+            fprintf(out, spec, *arg ? strtoll(arg, &end, 0) : 0LL);
+            break;
+            
+        case 'u': case 'o': case 'x': case 'X':
+            sprintf(spec + len, "ll%c", conv);
+            fprintf(out, spec, *arg ? strtoull(arg, &end, 0) : 0ULL);
+            break;
+            
+        default: // e, E, f, g, G
+            spec[len] = conv;
+            spec[len + 1] = '\0';
+            fprintf(out, spec, *arg ? strtod(arg, &end) : 0.0);
+    }
+    
+    return end && (end == arg || *end || errno) ? -1 : 0;
+}
+
+void cmd_printf_handler(Process * p) {
+    char spec[MAX_LINE_COMMAND];
+    const char * f;
+    int arg = 2, used, n;
+    
+    if (p->argc < 2) {
+        print_error("Formato: %s <formato> [argumentos...]\n", CMDPRINTF);
+        p->info = 2;
+        return;
+    }
+    
+    p->info = 0;
+    
+    do {
+        used = 0;
+        
+        for (f = p->args[1] ; *f ; ) {
+            
+            if (*f == '\\') {
+                f++;
+                put_escape(p->out, &f);
+            }
+            else if (*f != '%')
+                fputc(*f++, p->out);
+            else if (f[1] == '%') {
+                fputc('%', p->out);
+                f += 2;
+            }
+            else {
+                n = strspn(f + 1, "-+ #0123456789.");
+                
+                if (n + 5 > MAX_LINE_COMMAND || !f[n + 1] || !strchr("sciduoxXeEfgG", f[n + 1])) {
+                    fflush(p->out);
+                    print_error("%s : conversión no válida: %s\n", CMDPRINTF, f);
+                    p->info = 1;
+                    return;
+                }
+                
+                memcpy(spec, f, n + 1);
+                spec[n + 1] = '\0';
+                
+                if (put_conversion(p->out, spec, f[n + 1], arg < p->argc ? p->args[arg] : NULL) < 0) {
+                    fflush(p->out);
+                    print_error("%s : número no válido: %s\n", CMDPRINTF, p->args[arg]);
+                    p->info = 1;
+                }
+                
+                if (arg < p->argc)
+                    arg++;
+                
+                used++;
+                f += n + 2;
+            }
+        }
+        
+    } while (used && arg < p->argc);
+    
+}
+
+// Nanosegundos que quedan hasta end.
+static long long remaining_ns(const struct timespec * end) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return (end->tv_sec - now.tv_sec) * 1000000000LL + (end->tv_nsec - now.tv_nsec);
+}
+
+void cmd_sleep_handler(Process * p) {
+    struct timespec deadline, req = {0, 0};
+    double secs = 0, value;
+    long long left;
+    char * end;
+    int i;
+    
+    if (p->argc < 2) {
+        print_error("Formato: %s <segundos>[s|m|h|d]...\n", CMDSLEEP);
+        p->info = 1;
+        return;
+    }
+    
+    for (i = 1 ; i < p->argc ; i++) {
+        value = strtod(p->args[i], &end);
+        
+        if (end == p->args[i] || value < 0 || (*end && end[1]) || !strchr("smhd", *end)) {
+            print_error("%s : intervalo no válido: %s\n", CMDSLEEP, p->args[i]);
+            p->info = 1;
+            return;
+        }
+        
+        switch (*end) {
+            case 'm': value *= 60;    break;
+            case 'h': value *= 3600;  break;
+            case 'd': value *= 86400; break;
+        }
+        
+        secs += value;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t) secs;
+    deadline.tv_nsec += (long) ((secs - (time_t) secs) * 1e9);
+    
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    // En un proceso, Ctrl-C lo mata. En un hilo, la señal la recibe la shell,
+    // que marca p->interrupted: por eso se duerme a trozos.
+    while (!p->interrupted && (left = remaining_ns(&deadline)) > 0) {
+        req.tv_nsec = left < SLEEP_SLICE ? left : SLEEP_SLICE;
+        nanosleep(&req, NULL);
+    }
+    
+    p->info = p->interrupted ? 128 + SIGINT : 0;
+}
+
+static int test_number(const char * str, long long * n) {
+    char * end;
+    
+    errno = 0;
+    *n = strtoll(str, &end, 10);
+    
+    return end == str || *end || errno ? TEST_ERROR : 0;
+}
+
+static int test_unary(const char * op, const char * arg) {
+    struct stat st;
+    
+    if (strcmp(op, "-n") == 0)
+        return arg[0] != '\0';
+    
+    if (strcmp(op, "-z") == 0)
+        return arg[0] == '\0';
+    
+    if (strcmp(op, "-L") == 0)
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    
+    if (strlen(op) != 2 || op[0] != '-' || !strchr("efdrwxs", op[1]))
+        return TEST_ERROR;
+    
+    if (stat(arg, &st) < 0)
+        return 0;
+    
+    switch (op[1]) {
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 's': return st.st_size > 0;
+        default:  return 1;
+    }
+}
+
+static int test_binary(const char * a, const char * op, const char * b) {
+    static const char * ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    long long x, y;
+    int i;
+    
+    if (strcmp(op, "=") == 0)
+        return strcmp(a, b) == 0;
+    
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+    
+    for (i = 0 ; i < 6 && strcmp(op, ops[i]) ; i++);
+    
+    if (i == 6 || test_number(a, &x) < 0 || test_number(b, &y) < 0)
+        return TEST_ERROR;
+    
+    switch (i) {
+        case 0:  return x == y;
+        case 1:  return x != y;
+        case 2:  return x < y;
+        case 3:  return x <= y;
+        case 4:  return x > y;
+        default: return x >= y;
+    }
+}
+
+/**
+ * Evalúa una expresión de test.
+ * 
+ * @return  1 si es cierta, 0 si no, o TEST_ERROR.
+ */
+
+static int test_eval(char ** args, int n) {
+    int res;
+    
+    if (n > 0 && strcmp(args[0], "!") == 0) {
+        res = test_eval(args + 1, n - 1);
+        return res == TEST_ERROR ? res : !res;
+    }
+    
+    switch (n) {
+        case 0:  return 0;
+        case 1:  return args[0][0] != '\0';
+        case 2:  return test_unary(args[0], args[1]);
+        case 3:  return test_binary(args[0], args[1], args[2]);
+        default: return TEST_ERROR;
+    }
+}
+
+void cmd_test_handler(Process * p) {
+    int res = test_eval(p->args + 1, p->argc - 1);
+    
+    if (res == TEST_ERROR) {
+        print_error("%s : expresión no válida.\n", CMDTEST);
+        p->info = 2;
+    }
+    else
+        p->info = !res;
+}
@@ -0,0 +1,531 @@
+/**
+ * Implementación del completado con el tabulador.
+ *
+ * @file  completion.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <completion.h>
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// Lista ordenada de nombres.
+typedef struct {
+    char ** names;
+    int count;
+    int size;
+} NameIndex;
+
+// Directorio listado recientemente.
+typedef struct {
+    char * path;                    // Ruta absoluta, acabada en '/', o NULL si está libre.
+    int wd;                         // Vigilancia de inotify, o -1.
+    char valid;                     // 0 si hay que volver a listarlo.
+    unsigned long used;             // Momento del último uso.
+    NameIndex index;
+} DirCache;
+
+static int notifyFd = -1;
+static char notifyTried = 0;
+
+// Comandos internos y ejecutables del PATH.
+static NameIndex builtins = {NULL, 0, 0};
+static NameIndex commands = {NULL, 0, 0};
+static char commandsValid = 0;
+static char * pathCopy = NULL;      // PATH con el que se construyó el índice.
+static int * pathWds = NULL;
+static int npathWds = 0;
+
+static DirCache dirs[COMPL_DIRS];
+static unsigned long tick = 0;
+
+// Números de trabajo.
+static NameIndex jobCommands = {NULL, 0, 0};
+static int (*jobCounter)() = NULL;
+static char jobNames[COMPL_JOBS][12];
+static const char * jobMatch[COMPL_JOBS];
+
+static void addName(NameIndex * index, const char * name, const char * suffix) {
+    
+    if (index->count == index->size) {
+        index->size = index->size ? 2 * index->size : 64;
+        index->names = (char **) realloc(index->names, index->size * sizeof(char *));
+    }
+    
+    index->names[index->count] = (char *) malloc(strlen(name) + strlen(suffix) + 1);
+    strcpy(index->names[index->count], name);
+    strcat(index->names[index->count++], suffix);
+}
+
+static void clearIndex(NameIndex * index) {
+    
+    while (index->count > 0)
+        free(index->names[--index->count]);
+    
+}
+
+static int compareNames(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * Ordena el índice y quita los nombres repetidos.
+ */
+
+static void sortIndex(NameIndex * index) {
+    int i, n = 0;
+    
+    qsort(index->names, index->count, sizeof(char *), compareNames);
+    
+    for (i = 0 ; i < index->count ; i++) {
+        
+        if (n > 0 && !strcmp(index->names[n - 1], index->names[i]))
+            free(index->names[i]);
+        else
+            index->names[n++] = index->names[i];
+    }
+    
+    index->count = n;
+}
+
+/**
+ * Primera posición del índice cuyo nombre no es menor que el prefijo.
+ */
+
+static int lowerBound(const NameIndex * index, const char * prefix) {
+    int lo = 0, hi = index->count, mid;
+    
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        
+        if (strcmp(index->names[mid], prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    return lo;
+}
+
+/**
+ * Devuelve en result los nombres del índice que empiezan por el prefijo.
+ */
+
+static void matchIndex(const NameIndex * index, const char * prefix, int plen, Completions * result) {
+    int first = lowerBound(index, prefix), last = first;
+    
+    while (last < index->count && !strncmp(index->names[last], prefix, plen))
+        last++;
+    
+    result->match = (const char **) index->names + first;
+    result->count = last - first;
+}
+
+// ---------------------------------------------------------------------------//
+// --------------------------------- INOTIFY ---------------------------------//
+// ---------------------------------------------------------------------------//
+
+static int watch(const char * path) {
+    
+    if (!notifyTried) {
+        notifyTried = 1;
+        notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    
+    return notifyFd < 0 ? -1 : inotify_add_watch(notifyFd, path, WATCH_MASK);
+}
+
+/**
+ * Indica si una vigilancia la usa alguien más que el directorio except.
+ */
+
+static int watchInUse(int wd, const DirCache * except) {
+    int i;
+    
+    for (i = 0 ; i < npathWds ; i++)
+        if (pathWds[i] == wd)
+            return 1;
+        
+    for (i = 0 ; i < COMPL_DIRS ; i++)
+        if (&dirs[i] != except && dirs[i].path && dirs[i].wd == wd)
+            return 1;
+        
+    return 0;
+}
+
+static void unwatch(int wd, const DirCache * except) {
+    
+    if (wd >= 0 && !watchInUse(wd, except))
+        inotify_rm_watch(notifyFd, wd);
+    
+}
+
+/**
+ * Invalida los índices de los directorios que han cambiado. Sin inotify no se
+ * puede saber, así que se invalida todo.
+ */
+
+static void drainEvents() {
+    char buff[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event * ev;
+    ssize_t n;
+    char * ptr;
+    int i, all = notifyFd < 0;
+    
+    while (!all && (n = read(notifyFd, buff, sizeof(buff))) > 0) {
+        
+        for (ptr = buff ; ptr < buff + n ; ptr += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *) ptr;
+            
+            if (ev->mask & IN_Q_OVERFLOW) {
+                all = 1;
+                continue;
+            }
+            
+            for (i = 0 ; i < npathWds ; i++)
+                if (pathWds[i] == ev->wd) {
+                    commandsValid = 0;
+                    
+                    if (ev->mask & IN_IGNORED)
+                        pathWds[i] = -1;
+                }
+                
+            for (i = 0 ; i < COMPL_DIRS ; i++)
+                if (dirs[i].path && dirs[i].wd == ev->wd) {
+                    dirs[i].valid = 0;
+                    
+                    if (ev->mask & IN_IGNORED)
+                        dirs[i].wd = -1;
+                }
+        }
+    }
+    
+    if (all) {
+        commandsValid = 0;
+        
+        for (i = 0 ; i < COMPL_DIRS ; i++)
+            dirs[i].valid = 0;
+    }
+    
+}
+
+// ---------------------------------------------------------------------------//
+// -------------------------------- COMANDOS ---------------------------------//
+// ---------------------------------------------------------------------------//
+
+/**
+ * Añade al índice los ejecutables de un directorio.
+ */
+
+static void listExecutables(NameIndex * index, const char * path) {
+    DIR * dp;
+    struct dirent * entry;
+    struct stat st;
+    
+    if (!(dp = opendir(path)))
+        return;
+    
+    while ( (entry = readdir(dp)) ) {
+        
+        if (entry->d_type == DT_DIR || entry->d_name[0] == '.')
+            continue;
+        
+        if (entry->d_type == DT_UNKNOWN && !fstatat(dirfd(dp), entry->d_name, &st, 0) && S_ISDIR(st.st_mode))
+            continue;
+        
+        if (!faccessat(dirfd(dp), entry->d_name, X_OK, 0))
+            addName(index, entry->d_name, "");
+    }
+    
+    closedir(dp);
+}
+
+/**
+ * Vuelve a construir el índice de comandos si ha cambiado el PATH o alguno
+ * de sus directorios.
+ */
+
+static void buildCommands() {
+    const char * path = getenv("PATH");
+    char * copy, * dir, * save;
+    int i, wd;
+    
+    if (!path)
+        path = "";
+    
+    if (commandsValid && pathCopy && !strcmp(pathCopy, path))
+        return;
+    
+    for (i = 0 ; i < npathWds ; i++) {
+        wd = pathWds[i];
+        pathWds[i] = -1;
+        unwatch(wd, NULL);
+    }
+    
+    free(pathCopy);
+    pathCopy = strdup(path);
+    npathWds = 0;
+    clearIndex(&commands);
+    
+    for (i = 0 ; i < builtins.count ; i++)
+        addName(&commands, builtins.names[i], "");
+    
+    copy = strdup(path);
+    
+    for (dir = strtok_r(copy, ":", &save) ; dir ; dir = strtok_r(NULL, ":", &save)) {
+        pathWds = (int *) realloc(pathWds, (npathWds + 1) * sizeof(int));
+        pathWds[npathWds++] = watch(dir);       // Antes de listar, para no perder cambios.
+        listExecutables(&commands, dir);
+    }
+    
+    free(copy);
+    sortIndex(&commands);
+    commandsValid = notifyFd >= 0;
+}
+
+// ---------------------------------------------------------------------------//
+// ------------------------------ DIRECTORIOS --------------------------------//
+// ---------------------------------------------------------------------------//
+
+/**
+ * Devuelve el índice de un directorio, listándolo si no estaba o ha cambiado.
+ * Si no hay sitio se reutiliza el directorio usado hace más tiempo.
+ *
+ * @param path  Ruta absoluta del directorio, acabada en '/'.
+ * @return      El directorio, o NULL si no se puede abrir.
+ */
+
+static DirCache * listDirectory(const char * path) {
+    DirCache * cache = NULL;
+    DIR * dp;
+    struct dirent * entry;
+    struct stat st;
+    char isdir;
+    int i;
+    
+    for (i = 0 ; i < COMPL_DIRS && !cache ; i++)
+        if (dirs[i].path && !strcmp(dirs[i].path, path))
+            cache = &dirs[i];
+        
+    if (!cache) {
+        cache = &dirs[0];
+        
+        for (i = 1 ; i < COMPL_DIRS ; i++)
+            if (!dirs[i].path || (cache->path && dirs[i].used < cache->used))
+                cache = &dirs[i];
+            
+        if (cache->path) {
+            free(cache->path);
+            cache->path = NULL;
+            unwatch(cache->wd, cache);
+        }
+        
+        cache->path = strdup(path);
+        cache->wd = -1;
+        cache->valid = 0;
+    }
+    
+    cache->used = ++tick;
+    
+    if (cache->valid)
+        return cache;
+    
+    if (cache->wd < 0)
+        cache->wd = watch(path);
+    
+    if (!(dp = opendir(path)))
+        return NULL;
+    
+    clearIndex(&cache->index);
+    
+    while ( (entry = readdir(dp)) ) {
+        
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            isdir = !fstatat(dirfd(dp), entry->d_name, &st, 0) && S_ISDIR(st.st_mode);
+        else
+            isdir = entry->d_type == DT_DIR;
+        
+        addName(&cache->index, entry->d_name, isdir ? "/" : "");
+    }
+    
+    closedir(dp);
+    sortIndex(&cache->index);
+    cache->valid = cache->wd >= 0;
+    
+    return cache;
+}
+
+/**
+ * Completa una ruta con los nombres de su directorio.
+ */
+
+static void completePath(const char * word, int wlen, Completions * result) {
+    char path[PATH_MAX], base[MAX_LINE_COMMAND];
+    const char * slash = NULL, * home;
+    DirCache * cache;
+    int i, dlen = 0, n;
+    
+    for (i = 0 ; i < wlen ; i++)
+        if (word[i] == '/')
+            slash = word + i;
+        
+    if (slash)
+        dlen = slash - word + 1;
+    
+    if (dlen > 0 && word[0] == '/')
+        n = snprintf(path, sizeof(path), "%.*s", dlen, word);
+    else if (dlen > 1 && word[0] == '~' && word[1] == '/' && (home = getenv("HOME")))
+        n = snprintf(path, sizeof(path), "%s%.*s", home, dlen - 1, word + 1);
+    else if (getcwd(path, sizeof(path)))
+        n = strlen(path) + snprintf(path + strlen(path), sizeof(path) - strlen(path), "/%.*s", dlen, word);
+    else
+        return;
+    
+    if (n >= (int) sizeof(path))
+        return;
+    
+    memcpy(base, word + dlen, wlen - dlen);
+    base[wlen - dlen] = '\0';
+    
+    if ( (cache = listDirectory(path)) )
+        matchIndex(&cache->index, base, wlen - dlen, result);
+    
+    result->typed = wlen - dlen;
+}
+
+// ---------------------------------------------------------------------------//
+// --------------------------------- PÚBLICO ---------------------------------//
+// ---------------------------------------------------------------------------//
+
+void addBuiltin(const char * name) {
+    addName(&builtins, name, "");
+    commandsValid = 0;
+}
+
+void addJobCommand(const char * name) {
+    addName(&jobCommands, name, "");
+}
+
+void setJobCounter(int (*count)()) {
+    jobCounter = count;
+}
+
+/**
+ * Completa un número de trabajo.
+ */
+
+static void completeJob(const char * word, int wlen, Completions * result) {
+    int i, total = jobCounter ? jobCounter() : 0;
+    
+    result->count = 0;
+    result->match = jobMatch;
+    result->typed = wlen;
+    
+    for (i = 1 ; i <= total && result->count < COMPL_JOBS ; i++) {
+        sprintf(jobNames[result->count], "%d", i);
+        
+        if (!strncmp(jobNames[result->count], word, wlen)) {
+            jobMatch[result->count] = jobNames[result->count];
+            result->count++;
+        }
+    }
+    
+}
+
+void completeWord(const char * line, int len, Completions * result) {
+    const char * word;
+    char prefix[MAX_LINE_COMMAND];
+    int start = len, prev, plen, digits, i;
+    
+    result->match = NULL;
+    result->count = result->typed = result->common = 0;
+    
+    while (start > 0 && line[start - 1] != ' ')
+        start--;
+    
+    word = line + start;
+    
+    // Palabra anterior, para saber qué se está completando.
+    for (prev = start ; prev > 0 && line[prev - 1] == ' ' ; prev--);
+    for (plen = 0 ; prev > 0 && line[prev - 1] != ' ' && line[prev - 1] != '|' ; prev--, plen++);
+    for (digits = 0 ; start + digits < len && isdigit(word[digits]) ; digits++);
+    
+    drainEvents();
+    
+    if (memchr(word, '/', len - start))
+        completePath(word, len - start, result);
+    else if (plen == 0) {
+        buildCommands();
+        memcpy(prefix, word, len - start);
+        prefix[len - start] = '\0';
+        matchIndex(&commands, prefix, len - start, result);
+        result->typed = len - start;
+    }
+    else {
+        
+        for (i = 0 ; i < jobCommands.count ; i++)
+            if ((int) strlen(jobCommands.names[i]) == plen && !strncmp(jobCommands.names[i], line + prev, plen)
+                && digits == len - start) {
+                completeJob(word, len - start, result);
+                break;
+            }
+            
+        if (i == jobCommands.count)
+            completePath(word, len - start, result);
+    }
+    
+    if (result->count > 0) {
+        result->common = strlen(result->match[0]);
+        
+        for (i = 1 ; i < result->count ; i++)
+            for (plen = result->typed ; plen < result->common ; plen++)
+                if (result->match[i][plen] != result->match[0][plen]) {
+                    result->common = plen;
+                    break;
+                }
+    }
+    
+}
+
+void destroyCompletion() {
+    int i;
+    
+    for (i = 0 ; i < COMPL_DIRS ; i++) {
+        clearIndex(&dirs[i].index);
+        free(dirs[i].path);
+        dirs[i].path = NULL;
+    }
+    
+    clearIndex(&commands);
+    clearIndex(&builtins);
+    clearIndex(&jobCommands);
+    free(pathCopy);
+    free(pathWds);
+    pathCopy = NULL;
+    pathWds = NULL;
+    npathWds = 0;
+    commandsValid = 0;
+    
+    if (notifyFd >= 0)
+        close(notifyFd);
+    
+    notifyFd = -1;
+    notifyTried = 0;
+    
+}
@@ -7,117 +7,550 @@
  */
 
 #include <history.h>
+#include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+// Posiciones que se acumulan antes de escribirlas en el índice.
+#define INDEX_CHUNK 1024
+
+// Bytes que se leen de una vez de las entradas nuevas de otras shells.
+#define SYNC_CHUNK 65536
+
+/**
+ * Abre un fichero del historial en $HOME.
+ * 
+ * @return  Descriptor del fichero, o -1 si hubo algún error.
+ */
+
+static int openHistFile(const char * name, int flags) {
+    char path[PATH_MAX];
+    const char * home = getenv("HOME");
+    
+    if (!home || snprintf(path, PATH_MAX, "%s/%s", home, name) >= PATH_MAX)
+        return -1;
+    
+    return open(path, flags | O_CLOEXEC, 0600);
+}
+
+/**
+ * Mapea en memoria, sólo para lectura, los size primeros bytes de un fichero.
+ */
+
+static const void * mapFile(int fd, size_t size) {
+    void * addr;
+    
+    if (size == 0)
+        return NULL;
+    
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
+/**
+ * Añade al índice la posición de cada entrada del historial a partir de la
+ * posición from. Sólo se indexan las entradas terminadas en salto de línea.
+ */
+
+static void indexTail(History * hist, int idx, size_t from) {
+    uint64_t chunk[INDEX_CHUNK];
+    const char * nl;
+    int n = 0;
+    
+    while (from < hist->size && (nl = memchr(hist->data + from, '\n', hist->size - from))) {
+        chunk[n++] = from;
+        from = nl - hist->data + 1;
+        
+        if (n == INDEX_CHUNK) {
+            write(idx, chunk, sizeof(chunk));
+            n = 0;
+        }
+    }
+    
+    if (n > 0)
+        write(idx, chunk, n * sizeof(uint64_t));
+}
+
+/**
+ * Comprueba que el índice corresponde al fichero: su última entrada debe estar
+ * dentro del fichero y empezar tras un salto de línea.
+ */
+
+static char validIndex(History * hist, const uint64_t * index, int count) {
+    uint64_t last;
+    
+    if (count == 0)
+        return 1;
+    
+    last = index[count-1];
+    
+    return last < hist->size && (last == 0 || hist->data[last-1] == '\n');
+}
+
+/**
+ * Posición siguiente a la última entrada del índice.
+ */
+
+static size_t indexEnd(History * hist, const uint64_t * index, int count) {
+    const char * nl;
+    
+    if (count == 0)
+        return 0;
+    
+    nl = memchr(hist->data + index[count-1], '\n', hist->size - index[count-1]);
+    
+    return nl ? nl - hist->data + 1 : hist->size;
+}
+
+/**
+ * Mapea el fichero del historial y su índice. Si el índice no corresponde al
+ * fichero se reconstruye, y si le faltan las últimas entradas (las de las
+ * sesiones anteriores), se le añaden. De esto se encarga sólo una shell a la
+ * vez: las demás no esperan, y las entradas que falten en el índice las leen
+ * como nuevas en syncHist().
+ */
+
+static void loadHistFile(History * hist) {
+    struct stat st;
+    const uint64_t * index;
+    size_t mapped;
+    int idx, count;
+    char locked;
+    
+    if ( (hist->fd = openHistFile(HIST_FILE, O_RDWR | O_CREAT | O_APPEND)) < 0 )
+        return;
+    
+    if ( (idx = openHistFile(HIST_INDEX, O_RDWR | O_CREAT | O_APPEND)) < 0 ) {
+        close(hist->fd);
+        hist->fd = -1;
+        return;
+    }
+    
+    locked = flock(idx, LOCK_EX | LOCK_NB) == 0;
+    
+    // El índice se mapea antes que el fichero, que sólo crece, para que no
+    // apunte más allá de lo mapeado.
+    fstat(idx, &st);
+    count = st.st_size / sizeof(uint64_t);
+    mapped = count * sizeof(uint64_t);
+    index = mapFile(idx, mapped);
+    
+    fstat(hist->fd, &st);
+    hist->size = st.st_size;
+    hist->data = mapFile(hist->fd, hist->size);
+    
+    if (hist->size > 0 && !hist->data)
+        hist->size = 0;
+    
+    if (!index || !validIndex(hist, index, count)) {
+        
+        if (index)
+            munmap((void *) index, mapped);
+        
+        index = NULL;
+        count = 0;
+        
+        if (locked)
+            ftruncate(idx, 0);
+    }
+    
+    if (locked) {
+        
+        // La última línea de una sesión que no terminó de escribirla se cierra.
+        if (hist->size > 0 && hist->data[hist->size-1] != '\n')
+            write(hist->fd, "\n", 1);
+        
+        indexTail(hist, idx, indexEnd(hist, index, count));
+        
+        if (index)
+            munmap((void *) index, mapped);
+        
+        fstat(idx, &st);
+        count = st.st_size / sizeof(uint64_t);
+        index = mapFile(idx, count * sizeof(uint64_t));
+        flock(idx, LOCK_UN);
+    }
+    
+    hist->index = index;
+    hist->stored = index ? count : 0;
+    hist->seen = indexEnd(hist, index, hist->stored);
+    hist->total = hist->stored;
+    close(idx);
+}
 
 void initHist(History * hist) {
-    hist->first = NULL;
-    hist->last = NULL;
+    uint32_t buckets = 1;
+    
+    hist->capacity = HIST_CAPACITY;
+    hist->ring = (Node *) calloc(hist->capacity, sizeof(Node));
+    
+    while (buckets < hist->capacity)
+        buckets <<= 1;
+    
+    hist->buckets = (HistString **) calloc(buckets, sizeof(HistString *));
+    hist->mask = buckets - 1;
+    
+    hist->editing.command = hist->line;
+    hist->editing.text = NULL;
+    hist->editing.backup = NULL;
+    hist->editing_on = 0;
+    hist->scratch.command = hist->scratch_line;
+    hist->scratch.text = NULL;
+    hist->scratch.backup = NULL;
+    hist->scratch.dirty = 0;
+    hist->selected = NULL;
+    
     hist->total = 0;
+    hist->dedup = 0;
+    hist->stored = 0;
+    hist->data = NULL;
+    hist->size = 0;
+    hist->index = NULL;
+    hist->fd = -1;
+    hist->own = -1;
+    initTrigrams(&hist->recent);
+    initTrigrams(&hist->past);
+    hist->past_from = 0;
+    initTrie(&hist->recent_prefixes);
+    initTrie(&hist->past_prefixes);
+    hist->past_prefixes_from = 0;
+    hist->touched = NULL;
+    hist->overlays = NULL;
+    hist->ntouched = hist->noverlays = 0;
+    loadHistFile(hist);
+}
+
+/**
+ * Hash FNV-1a de los len primeros caracteres de text.
+ */
+
+static uint32_t hashText(const char * text, int len) {
+    uint32_t hash = 2166136261u;
+    
+    while (len-- > 0)
+        hash = (hash ^ (unsigned char) *text++) * 16777619u;
+    
+    return hash;
+}
+
+/**
+ * Devuelve la cadena interna con el texto dado, creándola si no existe, y
+ * cuenta una referencia más.
+ */
+
+static HistString * intern(History * hist, const char * text, int len) {
+    uint32_t hash = hashText(text, len);
+    HistString ** bucket = &hist->buckets[hash & hist->mask];
+    HistString * str;
+    
+    for (str = *bucket ; str ; str = str->next)
+        
+        if (str->hash == hash && strncmp(str->text, text, len) == 0 && str->text[len] == '\0') {
+            str->refs++;
+            return str;
+        }
+    
+    str = (HistString *) malloc(sizeof(HistString) + len + 1);
+    memcpy(str->text, text, len);
+    str->text[len] = '\0';
+    str->hash = hash;
+    str->refs = 1;
+    str->last = 0;
+    str->next = *bucket;
+    *bucket = str;
+    
+    return str;
+}
+
+/**
+ * Quita una referencia a una cadena interna, y la libera si era la última.
+ */
+
+static void release(History * hist, HistString * str) {
+    HistString ** bucket;
+    
+    if (!str || --str->refs > 0)
+        return;
+    
+    for (bucket = &hist->buckets[str->hash & hist->mask] ; *bucket != str ; bucket = &((*bucket)->next));
+    
+    *bucket = str->next;
+    free(str);
+}
+
+/**
+ * Vacía una posición del buffer circular.
+ */
+
+static void clearSlot(History * hist, Node * slot) {
+    release(hist, slot->text);
+    slot->backup = NULL;
+    slot->text = NULL;
+    slot->command = NULL;
+    slot->dirty = 0;
+    slot->num = 0;
+}
+
+/**
+ * Guarda la entrada n en su posición del buffer circular, descartando la que
+ * hubiera.
+ */
+
+static Node * setSlot(History * hist, int n, const char * text, int len) {
+    Node * slot = &hist->ring[(n-1) % hist->capacity];
+    
+    clearSlot(hist, slot);
+    slot->text = intern(hist, text, len);
+    slot->command = slot->text->text;
+    slot->num = n;
+    
+    if (slot->text->last < n)
+        slot->text->last = n;
+    
+    return slot;
+}
+
+/**
+ * Indica si la entrada n está en el buffer circular.
+ */
+
+static char inRing(History * hist, int n) {
+    return n >= 1 && n <= hist->total && n > hist->total - hist->capacity;
+}
+
+/**
+ * Indica si la entrada n se borró por estar repetida.
+ */
+
+static char isTombstone(History * hist, int n) {
+    return inRing(hist, n) && hist->ring[(n-1) % hist->capacity].num == n &&
+           !hist->ring[(n-1) % hist->capacity].text;
 }
 
 void destroyHist(History * hist) {
-    Node * curr = hist->first;
-    Node * prev = NULL;
+    int i;
     
     hist->selected = NULL;
     
-    while (curr) {
-        prev = curr;
-        curr = curr->next;
+    for (i = 0 ; i < hist->capacity ; i++)
+        clearSlot(hist, &hist->ring[i]);
+    
+    for (i = 0 ; i < hist->noverlays ; i++)
+        free(hist->overlays[i]);
+    
+    free(hist->overlays);
+    free(hist->touched);
+    free(hist->ring);
+    free(hist->buckets);
+    destroyTrigrams(&hist->recent);
+    destroyTrigrams(&hist->past);
+    destroyTrie(&hist->recent_prefixes);
+    destroyTrie(&hist->past_prefixes);
+    
+    if (hist->data)
+        munmap((void *) hist->data, hist->size);
+    
+    if (hist->index)
+        munmap((void *) hist->index, hist->stored * sizeof(uint64_t));
+    
+    if (hist->fd >= 0)
+        close(hist->fd);
+}
 
-        if (prev->backup)
-            free(prev->backup);
-        
-        free(prev);
-    }
+/**
+ * Localiza la entrada n de las sesiones anteriores en el fichero mapeado.
+ * 
+ * @return  Longitud de la entrada, que empieza en *start.
+ */
+
+static int entryText(History * hist, int n, const char ** start) {
+    const char * end;
+    
+    *start = hist->data + hist->index[n-1];
+    end = memchr(*start, '\n', hist->data + hist->size - *start);
     
+    return end - *start;
 }
 
-static Node * createNode(char * cmd, Node * next, Node * prev) {
-    Node * tmp;
+/**
+ * Devuelve la entrada n si está en el buffer circular; si es de una sesión
+ * anterior, se carga del fichero.
+ */
+
+static Node * ringLine(History * hist, int n) {
+    Node * slot;
+    const char * start;
+    int len;
     
-    tmp = (Node *) malloc(sizeof(Node));
+    if (!inRing(hist, n) || isTombstone(hist, n))
+        return NULL;
     
-    if (cmd)
-        strcpy(tmp->command, cmd);
+    slot = &hist->ring[(n-1) % hist->capacity];
     
-    tmp->next = next;
-    tmp->prev = prev;
-    tmp->dirty = 0;
-    tmp->backup = NULL;
+    if (slot->num != n) {
+        
+        if (n > hist->stored)
+            return NULL;
+        
+        len = entryText(hist, n, &start);
+        slot = setSlot(hist, n, start, len);
+    }
+    
+    return slot;
 }
 
+/**
+ * Borra la entrada anterior con el mismo texto, si sigue en el buffer. Su
+ * posición queda marcada como borrada para que no se vuelva a cargar.
+ * 
+ * @return  La cadena interna de la entrada borrada, con una referencia más
+ *          para que no se libere antes de que la use la nueva, o NULL.
+ */
 
-void append(History * hist, char * cmd) {
-    Node * node;
+static HistString * removeDuplicate(History * hist, const char * cmd, int len) {
+    HistString * str;
+    Node * slot;
+    uint32_t hash = hashText(cmd, len);
+    
+    for (str = hist->buckets[hash & hist->mask] ; str ; str = str->next)
+        
+        if (str->hash == hash && strcmp(str->text, cmd) == 0)
+            break;
+    
+    if (!str || !inRing(hist, str->last))
+        return NULL;
     
-    node = createNode(cmd, NULL, hist->last);
+    slot = &hist->ring[(str->last - 1) % hist->capacity];
     
-    if (hist->last)
-        hist->last->next = node;
+    if (slot->num != str->last || slot->text != str)
+        return NULL;
     
-    hist->last = node;
+    str->refs++;
+    clearSlot(hist, slot);
+    slot->num = str->last;
+    
+    return str;
+}
+
+void append(History * hist, char * cmd) {
+    int len = strlen(cmd);
+    HistString * moved = NULL;
     
-    if (!hist->first)
-        hist->first = node;
+    if (hist->dedup)
+        moved = removeDuplicate(hist, cmd, len);
     
     hist->total++;
+    setSlot(hist, hist->total, cmd, len);
+    release(hist, moved);
+    addTrigrams(&hist->recent, hist->total, cmd, len);
+    addPrefixes(&hist->recent_prefixes, hist->total, cmd, len);
 }
 
 void appendUnprotectEntry(History * hist) {
-    append(hist, NULL);
-    hist->last->dirty = 1;
+    hist->editing_on = 1;
+    hist->editing.num = hist->total + 1;
+    hist->editing.dirty = 1;
+    hist->line[0] = '\0';
 }
 
 Node * getLastCommand(History * hist) {
-    return hist->last;
+    return hist->editing_on ? &hist->editing : ringLine(hist, hist->total);
 }
 
 Node * getFirstCommand(History * hist) {
-    return hist->first;
+    Node * line = NULL;
+    int n = hist->total - hist->capacity + 1;
+    
+    for (n = n < 1 ? 1 : n ; n <= hist->total && !line ; n++)
+        line = ringLine(hist, n);
+    
+    return line || !hist->editing_on ? line : &hist->editing;
 }
 
-void nextCommand(HistoryLine* node) {
+void nextCommand(History * hist, HistoryLine * node) {
+    int n;
+    
+    if (!*node)
+        return;
     
-    if (*node)
-        *node = (*node)->next;
+    for (n = (*node)->num + 1 ; isTombstone(hist, n) ; n++);
+    
+    if (hist->editing_on && n == hist->editing.num)
+        *node = &hist->editing;
+    else
+        *node = ringLine(hist, n);
     
 }
 
 HistoryLine getLine(History * hist, int n) {
-    HistoryLine line = hist->first;
+    HistoryLine line;
+    const char * start;
+    int len;
     
-    while (n > 1 && line) {
-        nextCommand(&line);
-        n--;
-    }
+    if ( (line = ringLine(hist, n)) || n < 1 || n > hist->stored || isTombstone(hist, n) )
+        return line;
     
-    return line;
+    // Entrada de una sesión anterior que ya no está en el buffer.
+    len = entryText(hist, n, &start);
+    
+    if (len >= MAX_LINE_COMMAND)
+        len = MAX_LINE_COMMAND - 1;
+    
+    memcpy(hist->scratch.command, start, len);
+    hist->scratch.command[len] = '\0';
+    hist->scratch.num = n;
+    
+    return &hist->scratch;
 }
 
-void prevCommand(HistoryLine * node) {
+void prevCommand(History * hist, HistoryLine * node) {
+    
+    int n;
     
-    if (*node)
-        *node = (*node)->prev;
+    if (!*node)
+        return;
+    
+    for (n = (*node)->num - 1 ; isTombstone(hist, n) ; n--);
+    
+    *node = ringLine(hist, n);
     
 }
 
 void cleanHistory(History * hist) {
-    Node * curr = hist->first;
+    int i;
     
-    while (curr) {
-        restoreNode(curr);
-        curr = curr->next;
-    }
+    for (i = 0 ; i < hist->ntouched ; i++)
+        restoreNode(hist->touched[i]);
     
+    hist->ntouched = 0;
 }
 
-void dirtyNode(Node * node) {
+void dirtyNode(History * hist, Node * node) {
+    int i;
     
-    if (node && !(node->dirty) && !node->backup)  {
-        node->backup = (char * ) malloc(sizeof(char) * MAX_LINE_COMMAND);
+    // Copia al escribir: la cadena interna no se modifica nunca.
+    if (node && !(node->dirty) && node->text)  {
+        
+        if (hist->ntouched == hist->noverlays) {
+            hist->noverlays = hist->noverlays ? 2 * hist->noverlays : HIST_OVERLAYS;
+            hist->touched = (Node **) realloc(hist->touched, hist->noverlays * sizeof(Node *));
+            hist->overlays = (char **) realloc(hist->overlays, hist->noverlays * sizeof(char *));
+            
+            for (i = hist->ntouched ; i < hist->noverlays ; i++)
+                hist->overlays[i] = (char *) malloc(sizeof(char) * MAX_LINE_COMMAND);
+        }
+        
+        hist->touched[hist->ntouched] = node;
+        node->backup = hist->overlays[hist->ntouched++];
         strcpy(node->backup, node->command);
+        node->command = node->backup;
         node->dirty = 1;
     }
     
@@ -125,50 +558,342 @@ void dirtyNode(Node * node) {
 
 void restoreNode(Node * node) {
     
-    if (node && node->dirty) {
-        strcpy(node->command, node->backup);
-        free(node->backup);
+    if (node && node->dirty && node->text) {
         node->backup = NULL;
+        node->command = node->text->text;
         node->dirty = 0;
     }
     
 }
 
 void removeLast(History * hist) {
-    Node * rm = hist->last;
+    Node * rm;
     
-    if (rm) {
-        
-        if (rm->prev) {
-            rm->prev->next = NULL;
-            hist->last = rm->prev;
-        }
-        else {
-            hist->first = NULL;
-            hist->last = NULL;
-        }
-        
-        if (rm->backup)
-            free(rm->backup);
-        
-        free(rm);
+    if (hist->editing_on) {
+        hist->editing_on = 0;
+    }
+    else if ( (rm = ringLine(hist, hist->total)) ) {
+        clearSlot(hist, rm);
         hist->total--;
+        
+        if (hist->stored > hist->total)
+            hist->stored = hist->total;
     }
     
 }
 
+void protectEntry(History * hist, HistoryLine line) {
+    
+    if (line == &hist->editing) {
+        append(hist, line->command);
+        hist->editing_on = 0;
+    }
+    
+}
 
+void saveEntry(History * hist, HistoryLine line) {
+    char buffer[MAX_LINE_COMMAND + 1];
+    int length = strlen(line->command);
+    
+    if (hist->fd < 0)
+        return;
+    
+    // Una sola escritura, para que no se mezcle con la de otra shell.
+    memcpy(buffer, line->command, length);
+    buffer[length] = '\n';
+    
+    // Con O_APPEND, tras la escritura la posición es el final de la entrada.
+    if (write(hist->fd, buffer, length + 1) == length + 1)
+        hist->own = lseek(hist->fd, 0, SEEK_CUR) - (length + 1);
+}
 
-void protectEntry(HistoryLine line) {
-    line->dirty = 0;
+void syncHist(History * hist) {
+    char buffer[SYNC_CHUNK], command[MAX_LINE_COMMAND];
+    char * line, * nl;
+    struct stat st;
+    ssize_t n;
+    int length;
+    
+    if (hist->fd < 0)
+        return;
+    
+    while (fstat(hist->fd, &st) == 0 && st.st_size > hist->seen &&
+           (n = pread(hist->fd, buffer, SYNC_CHUNK, hist->seen)) > 0) {
+        line = buffer;
+        
+        while ( (nl = memchr(line, '\n', buffer + n - line)) ) {
+            length = nl - line;
+            
+            // Las entradas propias ya están en el historial.
+            if (length > 0 && hist->seen + (line - buffer) != hist->own) {
+                
+                if (length >= MAX_LINE_COMMAND)
+                    length = MAX_LINE_COMMAND - 1;
+                
+                memcpy(command, line, length);
+                command[length] = '\0';
+                append(hist, command);
+            }
+            
+            line = nl + 1;
+        }
+        
+        // Una línea a medio escribir se lee en la siguiente llamada, salvo que
+        // no quepa en el buffer.
+        if (line == buffer && n < SYNC_CHUNK)
+            break;
+        
+        hist->seen += line == buffer ? n : line - buffer;
+    }
     
+    hist->own = -1;
 }
 
 char isUnprotectEntry(HistoryLine line) {
-    return line->dirty && !line->backup;
+    return line->dirty && !line->text;
 }
 
 
 char isEmptyEntry(HistoryLine line) {
     return strlen(line->command) == 0;
 }
+
+/**
+ * Busca en un índice de trigramas la entrada más reciente, anterior a before,
+ * que contiene query. Se recorre hacia atrás la lista más corta de los
+ * trigramas de query y se descartan las entradas que no están en las demás
+ * antes de comprobar el texto.
+ */
+
+static int searchIndex(History * hist, TrigramIndex * idx, const char * query, int len, int before) {
+    const Posting * lists[MAX_LINE_COMMAND], * shortest = NULL;
+    HistoryLine line;
+    int i, k, ntri = len - 2, lo = 0, hi, mid;
+    
+    for (i = 0 ; i < ntri ; i++) {
+        
+        if ( !(lists[i] = findTrigram(idx, query + i)) )
+            return 0;
+        
+        if (!shortest || lists[i]->count < shortest->count)
+            shortest = lists[i];
+    }
+    
+    // Primera posición con número >= before.
+    for (hi = shortest->count ; lo < hi ; ) {
+        mid = (lo + hi) / 2;
+        
+        if (shortest->nums[mid] < before)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    for (i = lo - 1 ; i >= 0 ; i--) {
+        
+        for (k = 0 ; k < ntri && (lists[k] == shortest || postingHas(lists[k], shortest->nums[i])) ; k++);
+        
+        if (k == ntri && (line = getLine(hist, shortest->nums[i])) && strstr(line->command, query))
+            return shortest->nums[i];
+    }
+    
+    return 0;
+}
+
+/**
+ * Primera entrada del siguiente tramo del fichero que hay que indexar, por
+ * debajo de from. Cada tramo es tan grande como lo ya indexado, y al menos
+ * HIST_INDEX_STEP, así que el índice se copia un número acotado de veces.
+ */
+
+static int chunkStart(History * hist, int from) {
+    int size = hist->stored + 1 - from;
+    
+    if (size < HIST_INDEX_STEP)
+        size = HIST_INDEX_STEP;
+    
+    return from - size > 1 ? from - size : 1;
+}
+
+/**
+ * Indexa el siguiente tramo de entradas del fichero, hacia las más antiguas.
+ * 
+ * @param chunk  Aquí se deja el índice del tramo, que hay que unir a past.
+ */
+
+static void indexPast(History * hist, TrigramIndex * chunk) {
+    const char * start;
+    int n, len, first = chunkStart(hist, hist->past_from);
+    
+    initTrigrams(chunk);
+    
+    for (n = first ; n < hist->past_from ; n++) {
+        len = entryText(hist, n, &start);
+        addTrigrams(chunk, n, start, len);
+    }
+    
+    hist->past_from = first;
+}
+
+int searchHistory(History * hist, const char * query, int before) {
+    HistoryLine line;
+    TrigramIndex chunk;
+    int len = strlen(query), n;
+    
+    if (len == 0)
+        return 0;
+    
+    if (before > hist->total + 1)
+        before = hist->total + 1;
+    
+    // Sin trigramas, se recorre el historial.
+    if (len < 3) {
+        
+        for (n = before - 1 ; n > 0 ; n--)
+            
+            if ( (line = getLine(hist, n)) && strstr(line->command, query) )
+                return n;
+        
+        return 0;
+    }
+    
+    if ( (n = searchIndex(hist, &hist->recent, query, len, before)) )
+        return n;
+    
+    if (!hist->past_from)
+        hist->past_from = hist->stored + 1;
+    
+    if (before > hist->stored + 1)
+        before = hist->stored + 1;
+    
+    n = searchIndex(hist, &hist->past, query, len, before);
+    
+    // Lo que falta del fichero se indexa por tramos, sólo hasta encontrarla.
+    while (!n && hist->past_from > 1) {
+        indexPast(hist, &chunk);
+        n = searchIndex(hist, &chunk, query, len, before);
+        mergeTrigrams(&hist->past, &chunk);
+    }
+    
+    return n;
+}
+
+/**
+ * Recorre las entradas de first a last (incluidas), en la dirección dir, y
+ * devuelve la primera que empieza por prefix, o 0.
+ */
+
+static int scanPrefix(History * hist, const char * prefix, int len, int first, int last, int dir) {
+    HistoryLine line;
+    int n;
+    
+    for (n = first ; dir < 0 ? n >= last : n <= last ; n += dir)
+        
+        if ( (line = getLine(hist, n)) && strncmp(line->command, prefix, len) == 0 )
+            return n;
+    
+    return 0;
+}
+
+/**
+ * Busca en un árbol de prefijos la entrada más cercana a from, en la dirección
+ * dir, que empieza por prefix. Si el prefijo es más largo de lo que indexa el
+ * árbol, se comprueba el texto de las candidatas. Si el nodo descartó sus
+ * entradas más antiguas, las anteriores a su lista se buscan recorriendo el
+ * historial.
+ */
+
+static int searchTrie(History * hist, PrefixTrie * trie, const char * prefix, int len, int from, int dir) {
+    const TrieNode * node;
+    HistoryLine line;
+    int lo = 0, hi, mid, i, oldest, n;
+    
+    if ( !(node = findPrefix(trie, prefix, len)) )
+        return 0;
+    
+    oldest = node->count > 0 ? node->nums[0] : hist->total + 1;
+    
+    if (dir > 0 && node->truncated && from + 1 < oldest &&
+        (n = scanPrefix(hist, prefix, len, from + 1, oldest - 1, dir)))
+        return n;
+    
+    // Primera posición con número >= from.
+    for (hi = node->count ; lo < hi ; ) {
+        mid = (lo + hi) / 2;
+        
+        if (node->nums[mid] < from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    i = dir < 0 ? lo - 1 : (lo < node->count && node->nums[lo] == from ? lo + 1 : lo);
+    
+    for (; i >= 0 && i < node->count ; i += dir)
+        
+        if ( (line = getLine(hist, node->nums[i])) && strncmp(line->command, prefix, len) == 0 )
+            return node->nums[i];
+    
+    if (dir < 0 && node->truncated)
+        return scanPrefix(hist, prefix, len, (from < oldest ? from : oldest) - 1, 1, dir);
+    
+    return 0;
+}
+
+/**
+ * Añade al árbol de prefijos el siguiente tramo de entradas del fichero, hacia
+ * las más antiguas.
+ * 
+ * @param chunk  Aquí se deja el árbol del tramo, que hay que unir a past_prefixes.
+ */
+
+static void indexPastPrefixes(History * hist, PrefixTrie * chunk) {
+    const char * start;
+    int n, len, first = chunkStart(hist, hist->past_prefixes_from);
+    
+    initTrie(chunk);
+    
+    for (n = first ; n < hist->past_prefixes_from ; n++) {
+        len = entryText(hist, n, &start);
+        addPrefixes(chunk, n, start, len);
+    }
+    
+    hist->past_prefixes_from = first;
+}
+
+int searchPrefix(History * hist, const char * prefix, int from, int dir) {
+    PrefixTrie chunk;
+    int len = strlen(prefix), n;
+    
+    if (!hist->past_prefixes_from)
+        hist->past_prefixes_from = hist->stored + 1;
+    
+    // Hacia atrás se buscan antes las entradas de la sesión; hacia delante, las del fichero.
+    if (dir < 0) {
+        
+        if ( (n = searchTrie(hist, &hist->recent_prefixes, prefix, len, from, dir)) )
+            return n;
+        
+        n = searchTrie(hist, &hist->past_prefixes, prefix, len, from, dir);
+        
+        // Lo que falta del fichero se indexa por tramos, sólo hasta encontrarla.
+        while (!n && hist->past_prefixes_from > 1) {
+            indexPastPrefixes(hist, &chunk);
+            n = searchTrie(hist, &chunk, prefix, len, from, dir);
+            mergePrefixes(&hist->past_prefixes, &chunk);
+        }
+        
+        return n;
+    }
+    
+    // Hacia delante, hacen falta las entradas que hay tras from.
+    while (hist->past_prefixes_from > from + 1) {
+        indexPastPrefixes(hist, &chunk);
+        mergePrefixes(&hist->past_prefixes, &chunk);
+    }
+    
+    if ( (n = searchTrie(hist, &hist->past_prefixes, prefix, len, from, dir)) )
+        return n;
+    
+    return searchTrie(hist, &hist->recent_prefixes, prefix, len, from, dir);
+}
@@ -12,14 +12,17 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 
 // Includes form shell
 #include <defs.h>
 #include <history.h>
+#include <completion.h>
 #include <IOModule.h>
 
 #define KEY_ENTER      10
 #define KEY_SUP        127
+#define KEY_TAB        9
 
 #define EMACS_FORWARD  6
 #define EMACS_BACKWARD 2
@@ -28,31 +31,67 @@
 #define EMACS_START_L  1
 #define EMACS_END_LIN  5
 #define EMACS_DELETE   4
+#define EMACS_SEARCH   18
 
 #define CUR_SAVE "\033[s"
 #define CUR_REST "\033[u"
+#define CLR_EOL  "\033[K"
 
-static char getch() {
-    int shell_terminal = STDIN_FILENO;
-    struct termios conf;
+// Pegado entre corchetes: la terminal marca el inicio y el fin de lo pegado.
+#define PASTE_ON    "\033[?2004h"
+#define PASTE_OFF   "\033[?2004l"
+#define PASTE_END   "[201~"
+
+// Teclas leídas de la terminal y aún no procesadas.
+static char input[INPUT_BUFFER];
+static int inputPos = 0, inputLen = 0;
+static char inputClosed = 0;            // 1 si la última lectura no devolvió nada.
+
+/**
+ * Pone la terminal en modo crudo (sin eco ni edición de línea), guardando
+ * antes su configuración.
+ * 
+ * @param conf  Aquí se guarda la configuración actual.
+ */
+
+static void rawMode(struct termios * conf) {
     struct termios conf_new;
-    char c;
     
-    // leemos la configuración actual.
-    tcgetattr(shell_terminal, &conf);
-    conf_new = conf;
+    tcgetattr(STDIN_FILENO, conf);
+    conf_new = *conf;
     
     conf_new.c_lflag &= (~(ICANON | ECHO));
     conf_new.c_cc[VTIME] = 0;
     conf_new.c_cc[VMIN]  = 1;
     
-    tcsetattr(shell_terminal, TCSANOW, &conf_new);
-    
-    c = getc(stdin);
+    tcsetattr(STDIN_FILENO, TCSANOW, &conf_new);
+}
+
+/**
+ * Devuelve la siguiente tecla. Cuando no quedan, se leen de una vez todas las
+ * que haya disponibles (una pegada llega en una sola lectura).
+ * 
+ * pre: la terminal está en modo crudo.
+ */
+
+static char getch() {
+    ssize_t n;
     
-    tcsetattr(shell_terminal, TCSANOW, &conf);
+    if (inputPos == inputLen) {
+        fflush(stdout);
+        
+        while ( (n = read(STDIN_FILENO, input, INPUT_BUFFER)) < 0 && errno == EINTR );
+        
+        inputClosed = n <= 0;
+        
+        if (inputClosed)
+            return EMACS_DELETE;
+        
+        inputPos = 0;
+        inputLen = n;
+    }
     
-    return c;
+    return input[inputPos++];
 }
 
 /**
@@ -71,156 +110,234 @@ static void fill(char * buff, int length, char c) {
     
 }
 
+// Final del hueco cuando está pegado al final: se reserva sitio para el '\0'.
+#define GAP_LIMIT (MAX_LINE_COMMAND - 1)
+
 /**
- * Imprime N espacios en la salida estandar.
- * 
- * @param n  Número de espacios a escribir.
+ * Línea en edición, guardada como un buffer con hueco (gap buffer). El texto es
+ * buf[0, gap) seguido de buf[end, GAP_LIMIT), y el cursor está siempre en el
+ * hueco, por lo que insertar o borrar junto al cursor no mueve el resto de la
+ * línea. Sólo se aplana sobre el comando de la línea del historial al cambiar
+ * de línea o al pulsar Intro.
  */
 
-static void printNSpaces(int n) {
-    int i;
-    
-    for (i = 0 ; i < n ; i++)
-        putchar(' ');
-    
+typedef struct {
+    char buf[MAX_LINE_COMMAND];
+    int gap;                   // Inicio del hueco (posición del cursor).
+    int end;                   // Fin del hueco.
+    int changed;               // Primera posición modificada desde el último dibujado.
+    HistoryLine line;          // Línea del historial que se está editando.
+} GapBuffer;
+
+static GapBuffer editor;
+
+/**
+ * Longitud del texto de la línea en edición.
+ */
+
+static int textLength(const GapBuffer * ed) {
+    return ed->gap + GAP_LIMIT - ed->end;
 }
 
 /**
- * Desplaza los caracteres del array desde la posición hasta una posición determinada.
- * El límite es MAX_COMMAND_LINE.
- * 
- * @param buff     array de carácteres.
- * @param pos      posición desde donde se empieeza a mover carácteres.
- * @param length   posición final.
+ * Carga una línea del historial en el buffer, con el cursor al final.
+ *
+ * @param ed    Buffer de edición.
+ * @param line  Línea que pasa a editarse.
+ */
+
+static void loadLine(GapBuffer * ed, HistoryLine line) {
+    ed->gap = strlen(line->command);
+    memcpy(ed->buf, line->command, ed->gap);
+    ed->end = GAP_LIMIT;
+    ed->changed = 0;
+    ed->line = line;
+}
+
+/**
+ * Vuelca el buffer sobre el comando de la línea, si ésta se ha modificado.
+ *
+ * @param ed    Buffer de edición.
  */
 
-static void shiftRight(char * buff, int pos, int length) {
-    // uso la longitud como índice hacia atrás, la idea es dejar un hueco en la posición "pos"
+static void flattenLine(GapBuffer * ed) {
+    char * cmd = ed->line->command;
     
-    while ( length < MAX_LINE_COMMAND && length != pos) {
-        buff[length] = buff[length - 1];
-        length--;
+    if (ed->line->dirty) {
+        memcpy(cmd, ed->buf, ed->gap);
+        memcpy(cmd + ed->gap, ed->buf + ed->end, GAP_LIMIT - ed->end);
+        cmd[textLength(ed)] = '\0';
     }
-
+    
 }
 
 /**
- * Desplaza los caracteres del array hasta que encuentre el fin de la cadena o llegue a la longitud.
- * 
- * @param buff    Array de carácteres.
- * @param pos     Posición desde donde empezar.
- * @param length  Longitud de la caracteres.
+ * Mueve el hueco (y con él, el cursor) a la posición indicada.
+ *
+ * @param ed    Buffer de edición.
+ * @param pos   Nueva posición del cursor.
  */
 
-static void shiftLeft(char * buff, int pos, int length) {
+static void moveGap(GapBuffer * ed, int pos) {
     
-    while (pos <= length && buff[pos - 1] != '\0') {
-        buff[pos - 1] = buff[pos];
-        pos++;
-    }
+    while (ed->gap > pos)
+        ed->buf[--ed->end] = ed->buf[--ed->gap];
+    
+    while (ed->gap < pos)
+        ed->buf[ed->gap++] = ed->buf[ed->end++];
     
 }
 
 /**
- * Limpia el prompt de la terminal introduciendo espacios.
- * 
- * pre: se ha establecido antes una posición del prompt
- * 
- * @param length  Número de espacios a introducir.
+ * Anota la primera posición que hay que volver a dibujar.
  */
 
-static void clearPrompt(int length) {
-    printf(CUR_REST);
-    printNSpaces(length);  
+static void markChanged(GapBuffer * ed, int pos) {
+    
+    if (pos < ed->changed)
+        ed->changed = pos;
+    
 }
 
 /**
  * Procesa la pulsación de un caracter desde teclado. Actúa convirtiendo en dirty la entrada
  * del historial, si esta estuviera limpia(clean).
  *
- * @param line    Linea del historial que se va a modificar.
- * @param cursor  Referencia al cursor.
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea que se va a modificar.
  * @param c       Caracter que se va a procesar.
- * @param length  Referencia a la longitud de la palabra dentro del buffer.
  */
 
-static void characterProcess(HistoryLine line, int * cursor, int * length, char c) {
-
-    if (isprint(c) && (*cursor) < MAX_LINE_COMMAND - 1) {
-        
-        if (!line->dirty)
-            dirtyNode(line);
+static void characterProcess(History * hist, GapBuffer * ed, char c) {
+    
+    if (isprint(c) && ed->gap < ed->end) {
         
-        shiftRight(line->command, *cursor, *length);    // Desplazo hacia la derecha.
-        line->command[*cursor] = c;                     // Guardo el caracter en el hueco.
-        (*length)++;                           // Incremento la longitud.
-        (*cursor)++;                           // Muevo el cursor a la derecha.
+        if (!ed->line->dirty)
+            dirtyNode(hist, ed->line);
         
+        markChanged(ed, ed->gap);
+        ed->buf[ed->gap++] = c;                // Guardo el caracter en el hueco.
     }
     
 }
 
-static void upArrowProcess(HistoryLine * line, int * cursor, int * length) {
-    HistoryLine back = *line;
+static void upArrowProcess(History * hist, GapBuffer * ed) {
+    HistoryLine back = ed->line;
     
-    prevCommand(&back);
+    flattenLine(ed);
+    prevCommand(hist, &back);
     
-    if (back) {
-        *line = back;                             // Cambio la línea por la anterior.
-        *cursor = strlen((*line)->command);       // ajusto el cursor al final de la linea.
-        clearPrompt(*length);                     // borro la palabra que estaba en prompt
-        *length = *cursor;                        // Ajusto la nueva longitud dela palabra.
-    }
+    if (back)
+        loadLine(ed, back);                    // Cambio la línea por la anterior.
+    
+}
+
+static void downArrowProcess(History * hist, GapBuffer * ed) {
+    HistoryLine next = ed->line;
+    
+    flattenLine(ed);
+    nextCommand(hist, &next);
+    
+    if (next)
+        loadLine(ed, next);                    // Cambio la línea por la siguiente.
     
 }
 
-static void downArrowProcess(HistoryLine * line, int * cursor, int * length) {
-    HistoryLine next = *line;
+/**
+ * Navega por las entradas del historial que empiezan por lo que había escrito
+ * el usuario antes de la primera pulsación de Arriba/Abajo. Sin prefijo, se
+ * navega por todas las entradas. Bajando más allá de la última coincidencia se
+ * vuelve a la línea que se estaba escribiendo, con el prefijo.
+ * 
+ * Las coincidencias de sesiones anteriores que ya no están en el buffer se
+ * copian en la línea que se está escribiendo, como en la búsqueda inversa, así
+ * que la entrada a la que se ha llegado se lleva aparte en pos.
+ *
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea seleccionada.
+ * @param prefix  Prefijo, que se captura si plen es negativo.
+ * @param plen    Longitud del prefijo, o -1 si no se ha capturado.
+ * @param pos     Número de la entrada a la que se ha llegado.
+ * @param dir     -1 para Arriba, 1 para Abajo.
+ */
+
+static void prefixArrowProcess(History * hist, GapBuffer * ed, char * prefix, int * plen, int * pos, int dir) {
+    HistoryLine target = NULL, last;
+    int n;
     
-    nextCommand(&next);
+    if (*plen < 0) {
+        *plen = textLength(ed);
+        memcpy(prefix, ed->buf, ed->gap);
+        memcpy(prefix + ed->gap, ed->buf + ed->end, GAP_LIMIT - ed->end);
+        prefix[*plen] = '\0';
+        *pos = ed->line->num;
+    }
+    
+    if (*plen == 0) {
+        
+        if (dir < 0)
+            upArrowProcess(hist, ed);
+        else
+            downArrowProcess(hist, ed);
+        
+        return;
+    }
+    
+    flattenLine(ed);
+    last = getLastCommand(hist);
     
-    if (next) {
-        *line = next;                             // Cambio la línea por la siguiente.
-        *cursor = strlen((*line)->command);       // ajusto el cursor al final de la linea.
-        clearPrompt(*length);                     // borro la palabra que estaba en prompt
-        *length = *cursor;                        // Ajusto la nueva longitud dela palabra.
+    if ( (n = searchPrefix(hist, prefix, *pos, dir)) && (target = getLine(hist, n)) ) {
+        *pos = n;
+        
+        // El nodo de consulta se reutiliza: se edita una copia.
+        if (target->command == hist->scratch_line) {
+            strcpy(last->command, target->command);
+            target = last;
+        }
+        
+    }
+    else if (dir > 0 && *pos != last->num) {
+        *pos = last->num;
+        strcpy(last->command, prefix);
+        target = last;
     }
     
+    if (target)
+        loadLine(ed, target);
+    
 }
 
-static void leftArrowProcess(int * cursor) {
+static void leftArrowProcess(GapBuffer * ed) {
     
-    if (*cursor > 0)
-        (*cursor)--;
+    if (ed->gap > 0)
+        moveGap(ed, ed->gap - 1);
     
 }
 
-static void rigthArrowProcess(int * cursor, int lenght) {
+static void rigthArrowProcess(GapBuffer * ed) {
     
-    if (*cursor < lenght)
-        (*cursor)++;
+    if (ed->end < GAP_LIMIT)
+        moveGap(ed, ed->gap + 1);
     
 }
 
 /**
  * Borra un caracter hacia la izquierda desde la posición del cursor, en la línea
  * actual.
- * 
- * @param line     Línea seleccionada del historial
- * @param cursor   Posición del cursor.
- * @param length   Longitud de la palabra escrita en la linea.
+ *
+ * @param hist     Dirección del historial.
+ * @param ed       Buffer de la línea seleccionada.
  */
 
-static void borrar(HistoryLine line, int * cursor, int * length) {
+static void borrar(History * hist, GapBuffer * ed) {
     
-    if (*cursor > 0) {
+    if (ed->gap > 0) {
         
-        if (!line->dirty)
-            dirtyNode(line);
+        if (!ed->line->dirty)
+            dirtyNode(hist, ed->line);
         
-        shiftLeft(line->command, *cursor, *length);
-        (*cursor)--;
-        (*length)--;
+        ed->gap--;
+        markChanged(ed, ed->gap);
     }
     
 }
@@ -228,156 +345,405 @@ static void borrar(HistoryLine line, int * cursor, int * length) {
 /**
  * Borra un caracter hacia la derecha desde la posición del cursor, en la línea
  * actual.
- * 
- * @param line     Línea seleccionada del historial
- * @param cursor   Posición del cursor.
- * @param length   Longitud de la palabra escrita en la linea.
+ *
+ * @param hist     Dirección del historial.
+ * @param ed       Buffer de la línea seleccionada.
  */
 
-static void suprimir(HistoryLine line, int * cursor, int * length) {
+static void suprimir(History * hist, GapBuffer * ed) {
     
-    if (*cursor != *length) {
+    if (ed->end < GAP_LIMIT) {
         
-        if (!line->dirty)
-            dirtyNode(line);
+        if (!ed->line->dirty)
+            dirtyNode(hist, ed->line);
         
-        shiftLeft(line->command, *cursor + 1, *length);
-        (*length)--;
+        ed->end++;
+        markChanged(ed, ed->gap);
     }
     
 }
 
 /**
- * Imprime el comando por la pantalla, situando el cursor en la posición correcta.
+ * Inserta de una vez todo lo pegado, hasta la marca de fin ESC[201~. Los saltos
+ * de línea y tabuladores pasan a ser espacios, y la línea se dibuja una sola vez
+ * al terminar. Las secuencias CSI (ESC [ parámetros final) se leen enteras y se
+ * descartan, así que sólo la marca exacta termina el pegado; un ESC suelto o una
+ * secuencia a medias no se comen la marca.
  * 
- * @param buff        Buffer con el comando.
- * @param cursor      Posición del cursor.
- * @param length      Longitud del comando.
+ * @param hist     Dirección del historial.
+ * @param ed       Buffer de la línea seleccionada.
  */
 
-static void printCommand(const char * buff, int cursor, int length) {
-
-    clearPrompt(length+1);   // Borra el comando de la pantalla (+1 por si se borró el último)
-    printf(CUR_REST"%s"CUR_REST, buff);     // Restauro y imprimo el comando actual.
+static void pasteProcess(History * hist, GapBuffer * ed) {
+    char c, seq[sizeof(PASTE_END)];
+    size_t len;
     
-    if (cursor != 0)
-        printf("\033[%dC", cursor);     // Muevo el cursor a la posición correcta.
-}
-
-void parse_background_characters(char * cmd) {
-    int cur, length;
-    char * reject = "&+", ch = 0;
+    if (!ed->line->dirty)
+        dirtyNode(hist, ed->line);
     
-    length = strlen(cmd);
-    cur = 0;
+    markChanged(ed, ed->gap);
+    c = getch();
     
-    if ( strcspn(cmd,reject) != length) {
+    while (!inputClosed) {
         
-        while (cur < length) {
+        if (c == 27) {
             
-            if (cmd[cur] == '&' || cmd[cur] == '+') {
-                
-                if (ch == 0)
-                    ch = cmd[cur];
-                else if (ch == '&' && cmd[cur] == '+')
-                    ch = '+';
-                
-                shiftLeft(cmd,cur + 1, length);
-                length--;                
-                
-                if (cmd[cur] == ' ') {
-                    shiftLeft(cmd,cur + 1, length);
-                    length--;
-                }
-                
+            if ( (c = getch()) != '[' )
+                continue;                           // No es CSI: c se trata aparte.
+            
+            // Parámetros e intermedios (0x20-0x3F) hasta el byte final (0x40-0x7E).
+            for (seq[0] = c, len = 1 ; (c = getch()) >= 0x20 && c <= 0x3F ; )
                 
-            }
+                if (len < sizeof(seq))
+                    seq[len++] = c;
+            
+            if (c < 0x40 || c > 0x7E)
+                continue;                           // Secuencia cortada: c se trata aparte.
             
-            cur++;
+            if (len < sizeof(seq))
+                seq[len++] = c;
+            
+            if (len == sizeof(PASTE_END) - 1 && !memcmp(seq, PASTE_END, len))
+                break;
+            
+            c = getch();                            // Otras secuencias se descartan.
+            continue;
         }
         
-        if ( cmd[length - 1] != ' ') {
-            cmd[length] = ' ';
-            length++;
-        }
+        if (c == '\n' || c == '\r' || c == '\t')
+            c = ' ';
         
-        cmd[length] = ch;
-        cmd[length+1] = '\0';
+        if (isprint(c) && ed->gap < ed->end)
+            ed->buf[ed->gap++] = c;
+        
+        c = getch();
     }
     
 }
 
-void parse_history_commands(History * hist, char * cmd) {
-    char * rptr = strstr(cmd,CMDHIST);                        // Puntero de lectura.
-    char aux[MAX_LINE_COMMAND];
-    char * wptr = aux;                                        // Puntero de escritura.
-    char * mark,                                              // Marca de después de una escritura.
-         * mark2;                                             // Marca de inicio de lectura.
-    int num, length;
+// Línea que hay en la pantalla, para dibujar sólo lo que cambia.
+static char shown[MAX_LINE_COMMAND];
+static int shownLen = 0, shownCursor = 0;
+
+// Sugerencia que se muestra detrás de la línea.
+static char ghost[MAX_LINE_COMMAND];
+static int ghostLen = 0;
+
+/**
+ * Olvida lo que hay en la pantalla: se llama cuando el cursor está justo detrás
+ * del prompt y la línea está vacía.
+ */
+
+static void resetRender() {
+    shownLen = 0;
+    shownCursor = 0;
+    ghostLen = 0;
+}
+
+/**
+ * Añade al cuadro un movimiento del cursor de from a to.
+ */
+
+static int moveCursor(char * frame, int from, int to) {
+    
+    if (to < from)
+        return sprintf(frame, "\033[%dD", from - to);
+    else if (to > from)
+        return sprintf(frame, "\033[%dC", to - from);
+    
+    return 0;
+}
+
+/**
+ * Carácter en la posición i del texto del buffer.
+ */
+
+static char charAt(const GapBuffer * ed, int i) {
+    return i < ed->gap ? ed->buf[i] : ed->buf[i - ed->gap + ed->end];
+}
+
+/**
+ * Busca la sugerencia para la línea: lo que le falta para llegar a la entrada
+ * más reciente del historial que empieza por ella. Sólo se sugiere con el
+ * cursor al final de la línea.
+ * 
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea seleccionada.
+ * @return        La sugerencia, o una cadena vacía.
+ */
+
+static const char * suggestion(History * hist, GapBuffer * ed) {
     HistoryLine line;
+    int n;
+    
+    if (ed->gap == 0 || ed->end != GAP_LIMIT)
+        return "";
+    
+    ed->buf[ed->gap] = '\0';                   // El hueco está libre.
+    
+    if ( (n = searchPrefix(hist, ed->buf, getLastCommand(hist)->num, -1)) && (line = getLine(hist, n)) )
+        return line->command + ed->gap;
+    
+    return "";
+}
+
+/**
+ * Acepta la sugerencia que se está mostrando.
+ * 
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea seleccionada.
+ */
+
+static void acceptSuggestion(History * hist, GapBuffer * ed) {
+    int i;
+    
+    for (i = 0 ; i < ghostLen ; i++)
+        characterProcess(hist, ed, ghost[i]);
+    
+}
+
+/**
+ * Imprime el comando por la pantalla, situando el cursor en la posición correcta.
+ * Se compara con lo que ya hay en la pantalla desde la primera posición que se
+ * ha modificado y sólo se escribe desde el primer carácter que cambia, todo en
+ * una única escritura. Detrás de la línea se muestra atenuada la sugerencia.
+ *
+ * @param ed          Buffer con el comando.
+ * @param next        Sugerencia.
+ */
+
+static void printCommand(GapBuffer * ed, const char * next) {
+    char frame[2 * MAX_LINE_COMMAND + 64];
+    int length = textLength(ed), cursor = ed->gap;
+    int glen = strlen(next);
+    int diff, n = 0, i;
+    
+    // Lo anterior a la primera modificación ya está en la pantalla.
+    diff = ed->changed;
+    
+    if (diff > length)
+        diff = length;
+    
+    if (diff > shownLen)
+        diff = shownLen;
+    
+    while (diff < length && diff < shownLen && charAt(ed, diff) == shown[diff])
+        diff++;
+    
+    if (diff < length || diff < shownLen || glen != ghostLen || memcmp(next, ghost, glen)) {
+        n += moveCursor(frame + n, shownCursor, diff);
+        
+        for (i = diff ; i < length ; i++)
+            shown[i] = frame[n++] = charAt(ed, i);
+        
+        if (glen > 0)
+            n += sprintf(frame + n, C_SUGGEST "%s" C_DEFAULT, next);
+        
+        if (length + glen < shownLen + ghostLen)
+            n += sprintf(frame + n, CLR_EOL);
+        
+        memcpy(ghost, next, glen);
+        ghostLen = glen;
+        shownCursor = length + glen;
+    }
+    
+    n += moveCursor(frame + n, shownCursor, cursor);
+    
+    if (n > 0) {
+        fflush(stdout);
+        write(STDOUT_FILENO, frame, n);
+    }
+    
+    shownLen = length;
+    shownCursor = cursor;
+    ed->changed = MAX_LINE_COMMAND;
+}
+
+/**
+ * Lista los candidatos debajo de la línea y vuelve a dibujar el prompt.
+ * 
+ * @param ed      Buffer de la línea seleccionada.
+ * @param comp    Candidatos.
+ */
+
+static void listCompletions(GapBuffer * ed, const Completions * comp) {
+    char frame[32];
+    int i, n;
     
-    if (!rptr)
+    n = moveCursor(frame, shownCursor, shownLen);
+    n += sprintf(frame + n, CLR_EOL);
+    fflush(stdout);
+    write(STDOUT_FILENO, frame, n);
+    putchar('\n');
+    
+    for (i = 0 ; i < comp->count && i < COMPL_LIST ; i++)
+        printf("%s  ", comp->match[i]);
+    
+    if (comp->count > COMPL_LIST)
+        printf("... (%d más)", comp->count - COMPL_LIST);
+    
+    printf("\n" C_PROMPT TERM_PROMPT C_DEFAULT""CUR_SAVE"");
+    resetRender();
+    ed->changed = 0;
+}
+
+/**
+ * Completa la palabra que hay antes del cursor (Tab). Se añade lo que tienen
+ * en común todos los candidatos y, si sólo hay uno, un espacio detrás. Si no
+ * hay nada que añadir, se listan los candidatos.
+ * 
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea seleccionada.
+ */
+
+static void tabProcess(History * hist, GapBuffer * ed) {
+    Completions comp;
+    int i;
+    
+    completeWord(ed->buf, ed->gap, &comp);
+    
+    if (comp.count == 0) {
+        write(STDOUT_FILENO, "\a", 1);
         return;
+    }
+    
+    for (i = comp.typed ; i < comp.common ; i++)
+        characterProcess(hist, ed, comp.match[0][i]);
+    
+    if (comp.count == 1 && comp.match[0][comp.common - 1] != '/')
+        characterProcess(hist, ed, ' ');
+    else if (comp.count > 1 && comp.common == comp.typed)
+        listCompletions(ed, &comp);
+    
+}
+
+/**
+ * Búsqueda incremental hacia atrás en el historial (Ctrl-R). Cada carácter
+ * actualiza la búsqueda y Ctrl-R busca una coincidencia más antigua. Intro
+ * ejecuta la entrada encontrada; cualquier otra tecla la deja en la línea
+ * para editarla.
+ *
+ * @param hist    Dirección del historial.
+ * @param ed      Buffer de la línea seleccionada.
+ * @param exit    Se pone a 1 si se pulsó Intro.
+ */
+
+static void reverseSearch(History * hist, GapBuffer * ed, char * exit) {
+    char query[MAX_LINE_COMMAND];
+    int qlen = 0, match = 0, found = 1;
+    HistoryLine line;
+    char c;
     
-    mark = rptr;                                              // Por defecto
+    query[0] = '\0';
+    flattenLine(ed);
     
     do {
-        mark2 = rptr;                                         // marcamos el inicio de la lectura.
-        rptr += strlen(CMDHIST) + 1;                          // Avanzamos toda la palabra del 'historial' y un espacio.
+        printf(CUR_REST CLR_EOL "(%s)`%s': %s", found ? "búsqueda" : "búsqueda fallida", query,
+               match ? getLine(hist, match)->command : "");
+        c = getch();
         
-        while (*rptr == ' ')                                  // Avanzamos todos los espacios que halla de sobra.
-            rptr++;
-        
-        if (isdigit(*rptr) && (num = atoi(rptr)) <= hist->total) { // Si tal carácter es un dígito, y el número está en el rango del historial...
-            strncpy(wptr,mark,mark2-mark);                        // Copiamos la diferencia entre las dos marcas.
-            wptr += mark2-mark;                                   // avanzamos con el puntero.
-            // copiamos el comando que es.
-            line = getLine(hist, num);
-            length = strlen(line->command);
-            strncpy(wptr,line->command,length);
-            wptr += length;
-            // fin de copiado de comando.
-            while (rptr && *rptr != ' ' && *rptr != '\0')         // Quitamos espacios y posible final.
-                rptr++;
+        if (c == EMACS_SEARCH) {
+            
+            if (qlen > 0)
+                found = searchHistory(hist, query, match ? match : hist->total + 1);
+        }
+        else if (c == KEY_SUP) {
+            
+            if (qlen > 0)
+                query[--qlen] = '\0';
+            
+            // Con menos texto se vuelve a buscar desde la entrada más reciente.
+            match = searchHistory(hist, query, hist->total + 1);
+            found = match || qlen == 0;
+            continue;
+        }
+        else if (isprint(c) && qlen < MAX_LINE_COMMAND - 1) {
+            query[qlen++] = c;
+            query[qlen] = '\0';
+            // La coincidencia actual se mantiene si sigue valiendo.
+            found = searchHistory(hist, query, match ? match + 1 : hist->total + 1);
         }
-        else {                                                // Si no, copiamos todo y avanzamos con el puntero.
-            strncpy(wptr,mark,rptr-mark+1);
-            wptr += rptr-mark;
-        }                                                     // Fin si.
+        else
+            break;
         
-        mark = rptr;                                         // marca de postescritura.
-        rptr = strstr(rptr, CMDHIST);                        // buscamos la siguiente palabra historial.
+        if (found)
+            match = found;
         
-    } while (rptr && *rptr != '\0');                         // MIENTRAS, halla algo que leer.
+    } while (1);
+    
+    // Se descarta el resto de la secuencia de escape (flechas).
+    if (c == 27 && getch() == 91)
+        getch();
     
-    while (*mark != '\0') {                                  // Copiamos los restos.
-        *wptr = *mark;
-        wptr++;
-        mark++;
+    printf(CUR_REST CLR_EOL);
+    resetRender();
+    
+    if (match) {
+        line = getLastCommand(hist);
+        strcpy(line->command, getLine(hist, match)->command);
+        loadLine(ed, line);
     }
-    *wptr = '\0';                                            // Marcamos el fin de línea.
-    parse_background_characters(aux);
-    strcpy(cmd, aux);                                        // Copiamos el resultado al comando pasado como argumento.
+    
+    *exit = c == KEY_ENTER;
+}
+
+// Copias de las entradas expandidas que no están en memoria (ver historyText).
+static char refs[HIST_REFS][MAX_LINE_COMMAND];
+static int nrefs;
+
+/**
+ * Texto de una entrada del historial, para expandir "historial N". Las entradas
+ * que no están en memoria se leen en un buffer que se reutiliza, así que se
+ * copian para que sus vistas sigan siendo válidas.
+ * 
+ * @param n       Número de la entrada.
+ * @param ctx     Dirección del historial.
+ * @return        El texto, o NULL si no existe.
+ */
+
+static const char * historyText(int n, void * ctx) {
+    History * hist = (History *) ctx;
+    HistoryLine line = getLine(hist, n);
+    
+    if (!line || line->command != hist->scratch_line)
+        return line ? line->command : NULL;
+    
+    if (nrefs == HIST_REFS)
+        return NULL;
+    
+    strcpy(refs[nrefs], line->command);
+    
+    return refs[nrefs++];
 }
 
-char * getCommand(History * hist) {
-    int cursor = 0;                         // Posición del cursor.
+char * getCommand(History * hist, CommandLine * cl) {
     int length = 0;                         // Longitud del comando escrito por el usuario.
     char sec[3];                            // Acumulación de 3 carácteres (necesaria para las fechas)
     char exit = 0;
     HistoryLine lineSelected;
+    char prefix[MAX_LINE_COMMAND];          // Prefijo de la navegación con Arriba/Abajo.
+    char expanded[MAX_LINE_COMMAND];
+    int plen = -1;
+    int pos = 0;                            // Entrada a la que ha llegado la navegación.
+    char navigating;
+    struct termios conf;
     
-    printf(C_PROMPT TERM_PROMPT C_DEFAULT""CUR_SAVE"");
+    rawMode(&conf);                         // Modo crudo durante toda la edición.
+    printf(PASTE_ON C_PROMPT TERM_PROMPT C_DEFAULT""CUR_SAVE"");
+    resetRender();
     
     // Pre history.
+    syncHist(hist);                              // Recojo las entradas de otras shells.
     appendUnprotectEntry(hist);                  // Introduzco un nodo no protegido. (directamente editable)
     lineSelected = getLastCommand(hist);         // Selecciono la última línea.
     // end pre history
     
     fill(lineSelected->command,MAX_LINE_COMMAND,'\0');
+    loadLine(&editor, lineSelected);
     
     do {
         sec[0] = getch();
+        navigating = 0;
         
         switch(sec[0]) {
             
@@ -386,73 +752,98 @@ char * getCommand(History * hist) {
                 
                 if (sec[1] == 91) { // 27, 91 ...
                     sec[2] = getch();
-                    
+                
                     switch(sec[2]) {
                         
                         case 51: // Suprimir
-                            suprimir(lineSelected, &cursor,&length);
+                            suprimir(hist, &editor);
                             getch(); // Se queda un caracter basura (~)
                             break;
                             
-                        case 65: // Abajo
-                            upArrowProcess(&lineSelected, &cursor, &length);
+                        case 50: // Inicio de pegado (ESC[200~)
+                            
+                            if (getch() == '0' && getch() == '0' && getch() == '~')
+                                pasteProcess(hist, &editor);
+                            
                             break;
-                        
+                            
+                        case 65: // Arriba
+                            prefixArrowProcess(hist, &editor, prefix, &plen, &pos, -1);
+                            navigating = 1;
+                            break;
+                            
                         case 66: // Abajo
-                            downArrowProcess(&lineSelected, &cursor, &length);
+                            prefixArrowProcess(hist, &editor, prefix, &plen, &pos, 1);
+                            navigating = 1;
                             break;
-                        
+                            
                         case 67: // Derecha
-                            rigthArrowProcess(&cursor, length);
+                            
+                            if (editor.end == GAP_LIMIT)
+                                acceptSuggestion(hist, &editor);
+                            else
+                                rigthArrowProcess(&editor);
+                            
                             break;
-                        
+                            
                         case 68: // Izquierda
-                            leftArrowProcess(&cursor);
+                            leftArrowProcess(&editor);
                             break;
-                        
+                            
                         case KEY_ENTER:
                             exit = 1;
                             break;
                             
                         default:
-                            characterProcess(lineSelected, &cursor, &length, sec[2]);
+                            characterProcess(hist, &editor, sec[2]);
                             
                     }
                 }
                 else if (sec[1] != KEY_ENTER)
-                    characterProcess(lineSelected, &cursor, &length, sec[1]);
-                else 
+                    characterProcess(hist, &editor, sec[1]);
+                else
                     exit = 1;
-                    
+                
                 break;
                 
             case EMACS_BACKWARD:
-                leftArrowProcess(&cursor);
+                leftArrowProcess(&editor);
                 break;
                 
             case EMACS_FORWARD:
-                rigthArrowProcess(&cursor, length);
+                
+                if (editor.end == GAP_LIMIT)
+                    acceptSuggestion(hist, &editor);
+                else
+                    rigthArrowProcess(&editor);
+                
                 break;
                 
             case EMACS_PREVIOUS:
-                upArrowProcess(&lineSelected,&cursor,&length);
+                upArrowProcess(hist, &editor);
                 break;
                 
             case EMACS_NEXT:
-                downArrowProcess(&lineSelected, &cursor, &length);
+                downArrowProcess(hist, &editor);
                 break;
                 
             case EMACS_START_L:
-                cursor = 0;
+                moveGap(&editor, 0);
                 break;
                 
             case EMACS_END_LIN:
-                cursor = strlen(lineSelected->command);
+                
+                if (editor.end == GAP_LIMIT)
+                    acceptSuggestion(hist, &editor);
+                else
+                    moveGap(&editor, textLength(&editor));
+                
                 break;
                 
             case EMACS_DELETE:
-                strcpy(lineSelected->command, CMDEXIT);
-                length = 4;
+                dirtyNode(hist, editor.line);
+                strcpy(editor.line->command, CMDEXIT);
+                loadLine(&editor, editor.line);
                 exit = 1;
                 break;
                 
@@ -460,44 +851,92 @@ char * getCommand(History * hist) {
                 exit = 1;
                 break;
                 
+            case EMACS_SEARCH:
+                reverseSearch(hist, &editor, &exit);
+                break;
+                
             case KEY_SUP:
-                borrar(lineSelected, &cursor, &length);
+                borrar(hist, &editor);
+                break;
+                
+            case KEY_TAB:
+                tabProcess(hist, &editor);
                 break;
                 
             default:
-                characterProcess(lineSelected, &cursor, &length, sec[0]);
+                characterProcess(hist, &editor, sec[0]);
         }
         
+        // Cualquier otra tecla hace que el prefijo se vuelva a capturar.
+        if (!navigating)
+            plen = -1;
+        
         // Impresión del carácter.
         if (!exit)
-            printCommand(lineSelected->command, cursor, length);
-        else
+            printCommand(&editor, suggestion(hist, &editor));
+        else {
+            
+            if (ghostLen > 0)                  // La sugerencia no se queda en la pantalla.
+                printCommand(&editor, "");
+            
             putchar('\n');
-
+        }
+        
     } while (!exit);
     
+    // La línea sólo se aplana al terminar la edición.
+    flattenLine(&editor);
+    lineSelected = editor.line;
+    length = textLength(&editor);
+    
     // Copiado al historial.
     if (isEmptyEntry(lineSelected))  // Si es una linea vacía, se borra.
         removeLast(hist);
-    else {
-        
-        if (!isUnprotectEntry(lineSelected)) {                            // Si no es la última linea...
-            strcpy(getLastCommand(hist)->command, lineSelected->command); // Volcamos el comando a la última linea            
-            lineSelected = getLastCommand(hist);                          // Seleccionamos la última linea.            
-        }
-        
-        protectEntry(lineSelected);  // Protegemos la última línea.
-        
+    else if (!isUnprotectEntry(lineSelected)) {                       // Si no es la última linea...
+        strcpy(getLastCommand(hist)->command, lineSelected->command); // Volcamos el comando a la última linea
+        lineSelected = getLastCommand(hist);                          // Seleccionamos la última linea.
     }
     
     cleanHistory(hist);
     
+    // Se restaura la terminal antes de lanzar el comando.
+    printf(PASTE_OFF);
+    tcsetattr(STDIN_FILENO, TCSANOW, &conf);
+    
     if (length == 0) // No se introdujo nada (linea vacía);
         return NULL;
-    else {
-        parse_history_commands(hist,lineSelected->command);
+    
+    // Una sola pasada; las vistas apuntan a la línea que se está editando, que
+    // no cambia hasta la siguiente llamada.
+    nrefs = 0;
+    parse_line(lineSelected->command, cl, historyText, hist);
+    
+    // Se guarda con las referencias al historial ya expandidas. Si no caben, la
+    // línea se descarta: las vistas apuntan a entradas que protectEntry puede
+    // liberar.
+    if (cl->expanded) {
+        
+        if (unparse_line(cl, expanded, MAX_LINE_COMMAND) < 0) {
+            removeLast(hist);
+            print_error("La línea expandida es demasiado larga.\n");
+            return NULL;
+        }
         
-        return lineSelected->command;
+        strcpy(lineSelected->command, expanded);
+        parse_line(lineSelected->command, cl, NULL, NULL);
     }
+    
+    protectEntry(hist, lineSelected);                    // Protegemos la última línea.
+    lineSelected = getLastCommand(hist);
+    saveEntry(hist, lineSelected);
+    
+    if (cl->overflow) {
+        print_error("Demasiados argumentos o etapas en la tubería.\n");
+        return NULL;
+    }
+    
+    if (cl->nstages == 1 && cl->stages[0].argc == 0)  // Sólo había espacios o marcas.
+        return NULL;
+    
+    return lineSelected->command;
 }
-
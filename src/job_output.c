@@ -0,0 +1,401 @@
+/**
+ * Implementación de la captura de la salida de los trabajos.
+ * 
+ * @file  job_output.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#define _GNU_SOURCE
+#include <job_output.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+
+// Bytes por lectura de la tubería; acota el tiempo que se retiene el cerrojo.
+#define READ_CHUNK (OUTPUT_RING_SIZE / 4)
+
+void init_outputs(ListOutputs * list) {
+    *list = NULL;
+}
+
+/**
+ * Mapea el buffer circular: se reserva el doble de espacio y se mapea el mismo
+ * fichero en memoria en las dos mitades.
+ * 
+ * @return  Dirección del buffer, o NULL si hubo algún error.
+ */
+
+static char * map_ring() {
+    char * base;
+    int fd;
+    
+    if ( (fd = memfd_create("job-output", MFD_CLOEXEC)) < 0 )
+        return NULL;
+    
+    if (ftruncate(fd, OUTPUT_RING_SIZE) < 0 ||
+        (base = mmap(NULL, 2 * OUTPUT_RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    
+    if (mmap(base, OUTPUT_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + OUTPUT_RING_SIZE, OUTPUT_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * OUTPUT_RING_SIZE);
+        base = NULL;
+    }
+    
+    close(fd);
+    
+    return base;
+}
+
+/**
+ * Hilo que vacía la tubería del trabajo en el buffer circular hasta que todos
+ * los procesos la cierran. Se lee directamente en el buffer, sin copias.
+ */
+
+static void * drain_output(void * attr) {
+    OutputRing * out = (OutputRing *) attr;
+    struct pollfd pfd = { .fd = out->fd, .events = POLLIN };
+    sigset_t all;
+    ssize_t n = 1;
+    
+    // Las señales las atiende el hilo principal.
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    
+    while (n > 0) {
+        
+        if (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+            continue;
+        
+        pthread_mutex_lock(&out->lock);
+        n = read(out->fd, out->base + out->head % OUTPUT_RING_SIZE, READ_CHUNK);
+        
+        if (n > 0)
+            out->head += n;
+        else
+            out->closed = 1;
+        
+        pthread_cond_broadcast(&out->changed);
+        pthread_mutex_unlock(&out->lock);
+    }
+    
+    close(out->fd);
+    
+    return NULL;
+}
+
+static void free_output(OutputRing * out) {
+    pthread_join(out->tid, NULL);
+    munmap(out->base, 2 * OUTPUT_RING_SIZE);
+    pthread_mutex_destroy(&out->lock);
+    pthread_cond_destroy(&out->changed);
+    free(out->command);
+    free(out);
+}
+
+/**
+ * Si la lista está llena, descarta la salida terminada más antigua.
+ */
+
+static void evict_output(ListOutputs * list) {
+    OutputRing ** curr = list, ** oldest = NULL, * rm;
+    int total = 0;
+    
+    for (; *curr ; curr = &((*curr)->next)) {
+        total++;
+        
+        if (!oldest && (*curr)->closed)
+            oldest = curr;
+    }
+    
+    if (total >= MAX_OUTPUTS && oldest) {
+        rm = *oldest;
+        *oldest = rm->next;
+        free_output(rm);
+    }
+    
+}
+
+OutputRing * create_output(ListOutputs * list, const char * command, int * wfd) {
+    static int next_id = 1;
+    OutputRing * out, ** last;
+    int fdp[2];
+    
+    evict_output(list);
+    
+    if (pipe2(fdp, O_CLOEXEC) < 0)
+        return NULL;
+    
+    out = (OutputRing *) malloc(sizeof(OutputRing));
+    
+    if ( !(out->base = map_ring()) ) {
+        close(fdp[0]);
+        close(fdp[1]);
+        free(out);
+        return NULL;
+    }
+    
+    out->id = next_id++;
+    out->command = strdup(command);
+    out->head = 0;
+    out->fd = fdp[0];
+    out->closed = 0;
+    out->next = NULL;
+    pthread_mutex_init(&out->lock, NULL);
+    pthread_cond_init(&out->changed, NULL);
+    pthread_create(&out->tid, NULL, drain_output, out);
+    
+    for (last = list ; *last ; last = &((*last)->next));
+    *last = out;
+    
+    *wfd = fdp[1];
+    
+    return out;
+}
+
+OutputRing * search_output(ListOutputs list, int id) {
+    
+    while (list && list->id != id)
+        list = list->next;
+    
+    return list;
+}
+
+unsigned long write_output(OutputRing * out, unsigned long from, int fd) {
+    unsigned long head;
+    ssize_t n;
+    
+    pthread_mutex_lock(&out->lock);
+    head = out->head;
+    
+    // Lo que quede más atrás del tamaño del buffer ya se sobreescribió.
+    if (head - from > OUTPUT_RING_SIZE)
+        from = head - OUTPUT_RING_SIZE;
+    
+    while (from < head && (n = write(fd, out->base + from % OUTPUT_RING_SIZE, head - from)) > 0)
+        from += n;
+    
+    pthread_mutex_unlock(&out->lock);
+    
+    return head;
+}
+
+char output_status(OutputRing * out, unsigned long * head) {
+    char closed;
+    
+    pthread_mutex_lock(&out->lock);
+    *head = out->head;
+    closed = out->closed;
+    pthread_mutex_unlock(&out->lock);
+    
+    return closed;
+}
+
+char wait_output(OutputRing * out, unsigned long from, int timeout_ms) {
+    struct timespec limit;
+    char ready;
+    
+    clock_gettime(CLOCK_REALTIME, &limit);
+    limit.tv_nsec += (long) timeout_ms * 1000000;
+    limit.tv_sec += limit.tv_nsec / 1000000000;
+    limit.tv_nsec %= 1000000000;
+    
+    pthread_mutex_lock(&out->lock);
+    
+    if (out->head == from && !out->closed)
+        pthread_cond_timedwait(&out->changed, &out->lock, &limit);
+    
+    ready = out->head != from || out->closed;
+    pthread_mutex_unlock(&out->lock);
+    
+    return ready;
+}
+
+void destroy_outputs(ListOutputs * list) {
+    OutputRing * curr = *list, * next;
+    
+    while (curr) {
+        next = curr->next;
+        
+        // Los hilos de los trabajos que siguen vivos se abandonan.
+        if (curr->closed)
+            free_output(curr);
+        
+        curr = next;
+    }
+    
+    *list = NULL;
+}
+
+/**
+ * Tubería de un trabajo vigilada por el multiplexor. Guarda la línea
+ * incompleta hasta que llega su final.
+ */
+
+typedef struct {
+    int fd;
+    char * tag;
+    int taglen;
+    char line[MUX_LINE];
+    int len;
+} MuxStream;
+
+static int mux_epoll = -1;
+static char mux_out[MUX_BUFFER];
+static int mux_used;
+
+static void mux_flush() {
+    ssize_t n;
+    int done = 0;
+    
+    while (done < mux_used && (n = write(STDOUT_FILENO, mux_out + done, mux_used - done)) > 0)
+        done += n;
+    
+    mux_used = 0;
+}
+
+/**
+ * Añade al buffer de salida la línea de la tubería con su etiqueta.
+ */
+
+static void mux_emit(MuxStream * s, const char * tail, int n) {
+    
+    if (mux_used + s->taglen + s->len + n + 1 > MUX_BUFFER)
+        mux_flush();
+    
+    memcpy(mux_out + mux_used, s->tag, s->taglen);
+    mux_used += s->taglen;
+    memcpy(mux_out + mux_used, s->line, s->len);
+    mux_used += s->len;
+    memcpy(mux_out + mux_used, tail, n);
+    mux_used += n;
+    mux_out[mux_used++] = '\n';
+    s->len = 0;
+}
+
+/**
+ * Separa en líneas lo leído de una tubería. Lo que no acaba en salto de línea
+ * se guarda. Las líneas que superan MUX_LINE se cortan, así que cada registro
+ * cabe en el buffer de salida.
+ */
+
+static void mux_split(MuxStream * s, const char * data, int n) {
+    const char * nl;
+    int len, room;
+    
+    while (n > 0) {
+        nl = memchr(data, '\n', n);
+        len = nl ? nl - data : n;
+        room = MUX_LINE - s->len;
+        
+        if (nl && len <= room) {
+            mux_emit(s, data, len);
+            data = nl + 1;
+            n -= len + 1;
+        }
+        else if (len < room) {
+            memcpy(s->line + s->len, data, n);
+            s->len += n;
+            n = 0;
+        }
+        else {
+            mux_emit(s, data, room);
+            data += room;
+            n -= room;
+        }
+    }
+    
+}
+
+/**
+ * Hilo del multiplexor. Cada vez que epoll avisa se vacían las tuberías listas
+ * y se escribe todo lo acumulado de una vez.
+ */
+
+static void * mux_loop(void * attr) {
+    struct epoll_event events[MAX_OUTPUTS];
+    static char data[MUX_BUFFER];
+    MuxStream * s;
+    sigset_t all;
+    ssize_t n;
+    int ready, i;
+    
+    (void) attr;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    
+    while (1) {
+        
+        if ( (ready = epoll_wait(mux_epoll, events, MAX_OUTPUTS, -1)) < 0 )
+            continue;
+        
+        for (i = 0 ; i < ready ; i++) {
+            s = (MuxStream *) events[i].data.ptr;
+            
+            if ( (n = read(s->fd, data, MUX_BUFFER)) > 0 ) {
+                mux_split(s, data, n);
+            }
+            else if (n == 0 || errno != EINTR) {
+                
+                if (s->len > 0)
+                    mux_emit(s, "", 0);
+                
+                epoll_ctl(mux_epoll, EPOLL_CTL_DEL, s->fd, NULL);
+                close(s->fd);
+                free(s->tag);
+                free(s);
+            }
+            
+        }
+        
+        mux_flush();
+    }
+    
+    return NULL;
+}
+
+int mux_attach(const char * tag) {
+    struct epoll_event ev = { .events = EPOLLIN };
+    pthread_t tid;
+    MuxStream * s;
+    int fdp[2];
+    
+    if (mux_epoll < 0) {
+        
+        if ( (mux_epoll = epoll_create1(EPOLL_CLOEXEC)) < 0 )
+            return -1;
+        
+        pthread_create(&tid, NULL, mux_loop, NULL);
+        pthread_detach(tid);
+    }
+    
+    if (pipe2(fdp, O_CLOEXEC) < 0)
+        return -1;
+    
+    s = (MuxStream *) malloc(sizeof(MuxStream));
+    s->fd = fdp[0];
+    s->tag = strdup(tag);
+    s->taglen = strlen(tag);
+    s->len = 0;
+    ev.data.ptr = s;
+    
+    if (epoll_ctl(mux_epoll, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+        close(fdp[0]);
+        close(fdp[1]);
+        free(s->tag);
+        free(s);
+        return -1;
+    }
+    
+    return fdp[1];
+}
@@ -11,77 +11,87 @@
 #include <string.h>
 #include <stdio.h>
 
+// Siguiente número de la cola de trabajos.
+static unsigned long next_ticket = 0;
 
-static void allocateAndCopy(char ** dest, const char * orig, int count) {
-    *dest = (char*) malloc(sizeof (char) *(count + 1));
-    strncpy(*dest, orig, count);
-    (*dest)[count] = '\0';
-    *(dest + 1) = NULL;
+/**
+ * Copia una palabra, acabada en '\0', en el bloque de argumentos. Si no hay
+ * bloque (palabras prestadas), la palabra ya acaba en '\0' y se usa tal cual.
+ * 
+ * @return  Posición siguiente del bloque.
+ */
+
+static char * copy_token(char ** dest, char * ptr, Token tok) {
+    
+    if (ptr == NULL) {
+        *dest = (char *) tok.str;
+        return NULL;
+    }
+    
+    memcpy(ptr, tok.str, tok.len);
+    ptr[tok.len] = '\0';
+    *dest = ptr;
+    
+    return ptr + tok.len + 1;
 }
 
 static void _new_process(Process ** p) {
     *p = (Process *) malloc(sizeof (Process));
     (*p)->next = NULL;
     (*p)->argc = 0;
+    (*p)->outfile = NULL;
+    (*p)->pid = 0;
+    (*p)->info = 0;
+    (*p)->num_job = 0;
+    (*p)->out = stdout;
+    (*p)->threaded = 0;
+    (*p)->interrupted = 0;
     (*p)->state = READY;
 }
 
-static void prepare_job(Job * job) {
-    int i = 0;
-    Process ** proc = &(job->proc);
-    const char * ptr = job->command;
-    int offset = 0;
-    char del = ' ';
+/**
+ * Crea los procesos del trabajo, uno por etapa de la línea analizada. Todas las
+ * palabras se copian en un único bloque del trabajo.
+ */
 
-    _new_process(proc);
-    
-    while (ptr[offset] != '\0' && ptr[offset] != '&' && ptr[offset] != '+'  &&
-           (*proc)->argc < MAX_LINE_COMMAND) {
+static void prepare_job(Job * job, const CommandLine * cl) {
+    Process ** proc = &(job->proc);
+    Process * last = NULL;
+    const Stage * st;
+    char * ptr;
+    int i, j;
+    
+    if (cl->borrowed)
+        ptr = job->argbuf = NULL;
+    else
+        ptr = job->argbuf = (char *) malloc(sizeof(char) * (cl->size + 1));
+    
+    for (i = 0 ; i < cl->nstages ; i++) {
+        st = &cl->stages[i];
+        _new_process(proc);
+        last = *proc;
         
-        // Se procesa el caracter leido.
-        if (*ptr == ' ') {
-            ptr++;
-        } else if (*ptr == '|') { // Siguiente proceso...
-            proc = &((*proc)->next);
-            _new_process(proc);
-            i = 0;
-            ptr++;
-        } else if ((*ptr == '\'' || *ptr == '\"') && offset <= 1) { // cambio de delimitador.
-            del = *ptr;
-            offset++;
-        } else if (*(ptr + offset) == del) {
-
-            if (*(ptr + offset) != ' ') // Si el delimitador es distinto de espacio, lo copiamos.
-                allocateAndCopy(&(*proc)->args[i], ptr, offset + 1);
-            else // Si no, no cogemos el espacio.
-                allocateAndCopy(&(*proc)->args[i], ptr, offset);
-
-            i++;
-            ptr += offset + 1; // saltamos ese espacio.
-            offset = 0;
-            del = ' ';
-            ((*proc)->argc)++;
-        } else {
-            offset++;
-        }
-
-    } // end while.
-
-    if (*ptr == '+') {
+        for (j = 0 ; j < st->argc ; j++)
+            ptr = copy_token(&last->args[j], ptr, st->args[j]);
+        
+        // marca el fin del comando.
+        last->args[j] = NULL;
+        last->argc = st->argc;
+        
+        if (st->outfile.len)
+            ptr = copy_token(&last->outfile, ptr, st->outfile);
+        
+        proc = &(last->next);
+    }
+    
+    if (cl->respawnable) {
         job->respawnable = 1;
         job->foreground = 0;
     }
-    else if (*ptr == '&')
+    else if (cl->background)
         job->foreground = 0;
-    else if (*ptr != '\0' && offset != 0 && (*proc)->argc < MAX_ARGS) { // Si había algo que copiar; se hace.
-        allocateAndCopy(&(*proc)->args[i], ptr, offset);
-        i++;
-        ((*proc)->argc)++;
-    }
     
-    // marca el fin del comando.
-    (*proc)->args[i] = NULL;
-    job->info = &((*proc)->info);
+    job->info = &(last->info);
 }
 
 void init_list_jobs(ListJobs * list_jobs) {
@@ -90,27 +100,28 @@ void init_list_jobs(ListJobs * list_jobs) {
 
 void destroy_processes(Job * job, int n) {
     Process * curr, *prev = NULL, *rmNode = NULL;
-    char ** arg;
     
     curr = job->proc;
     
     while (curr) {
         
-        arg = curr->args;
-        
+        // Los argumentos están en el bloque del trabajo.
         if (n == -1 || n == curr->num_job ) {
             
-            while(*arg) {
-                free(*arg);
-                arg++;
-            }
-            
             if (prev)
                 prev->next = curr->next;
             else
                 job->proc = job->proc->next;
             
             rmNode = curr;
+            
+            // Una etapa interna puede seguir en marcha si el trabajo se detuvo
+            // y se continuó en background: se interrumpe para no esperar a un
+            // sleep entero.
+            if (curr->threaded) {
+                curr->interrupted = 1;
+                pthread_join(curr->thread, NULL);
+            }
         }
         else 
             prev = curr;            
@@ -138,12 +149,26 @@ void destroy_list_jobs(ListJobs * list_jobs) {
         prev = curr;
         destroy_processes(curr, -1);
         curr = curr->next;
+        free((char *) prev->command);
+        free(prev->argbuf);
+        free(prev->cpus);
         free(prev);
     }
     
 }
 
 Job * create_job(ListJobs * list_jobs, const char * cmd) {
+    CommandLine cl;
+    
+    if (list_jobs == NULL || cmd == NULL)
+        return NULL;
+    
+    parse_line(cmd, &cl, NULL, NULL);
+    
+    return create_parsed_job(list_jobs, cmd, &cl);
+}
+
+Job * create_parsed_job(ListJobs * list_jobs, const char * cmd, const CommandLine * cl) {
     Job ** curr = list_jobs;
 
     if (list_jobs == NULL || cmd == NULL)
@@ -153,7 +178,7 @@ Job * create_job(ListJobs * list_jobs, const char * cmd) {
         curr = &((*curr)->next);
 
     *curr = (Job *) malloc(sizeof (Job));
-    (*curr)->command = cmd;
+    (*curr)->command = strdup(cmd);
     (*curr)->foreground = 1;
     (*curr)->gpid = 0;
     (*curr)->status = READY;
@@ -166,7 +191,13 @@ Job * create_job(ListJobs * list_jobs, const char * cmd) {
     (*curr)->type = NORMAL_JOB;
     (*curr)->respawnable = 0;
     (*curr)->time_out = 0;
-    prepare_job(*curr);
+    (*curr)->ndeps = 0;
+    (*curr)->throttled = 0;
+    (*curr)->priority = -1;
+    (*curr)->cpus = NULL;
+    (*curr)->capture = 0;
+    (*curr)->output = NULL;
+    prepare_job(*curr, cl);
 
     return *curr;
 }
@@ -194,6 +225,9 @@ void remove_job_n(ListJobs * jobs, pid_t gpid, int n) {
             else
                 prev->next = curr->next;
             
+            free((char *) curr->command);
+            free(curr->argbuf);
+            free(curr->cpus);
             free(curr);
             curr = NULL;
         }
@@ -202,6 +236,23 @@ void remove_job_n(ListJobs * jobs, pid_t gpid, int n) {
     
 }
 
+void remove_job_ref(ListJobs * jobs, Job * job) {
+    Job ** curr = jobs;
+    
+    while (*curr && *curr != job)
+        curr = &((*curr)->next);
+    
+    if (*curr) {
+        *curr = job->next;
+        destroy_processes(job, -1);
+        free((char *) job->command);
+        free(job->argbuf);
+        free(job->cpus);
+        free(job);
+    }
+    
+}
+
 void reenumerate_job(Job * job) {
     Process * p = job->proc, * prev = NULL;
     int num = 0, anterior;
@@ -236,14 +287,18 @@ void dup_job_command(Job * job) {
         while (*src && (*src)->num_job == 0) {
             i = 0;
             *dst = (Process *) malloc(sizeof(Process));
-            // Copiamos todos los argumentos.
+            // Los argumentos se comparten: están en el bloque del trabajo.
             while ( (*src)->args[i] ) {
-                (*dst)->args[i] = (char *) malloc(sizeof(char) * strlen((*src)->args[i]));
-                strcpy( (*dst)->args[i], (*src)->args[i]);
+                (*dst)->args[i] = (*src)->args[i];
                 i++;
             }
             (*dst)->args[i] = NULL;
             (*dst)->argc = (*src)->argc;
+            (*dst)->outfile = (*src)->outfile;
+            (*dst)->info = 0;
+            (*dst)->out = stdout;
+            (*dst)->threaded = 0;
+            (*dst)->interrupted = 0;
             // Especificamos lo que queda.
             (*dst)->state = READY; 
             (*dst)->num_job = job->total;
@@ -358,6 +413,28 @@ void mark_process(Job * job, int status, pid_t pid) {
     
 }
 
+void interrupt_stages(Job * job) {
+    Process * p;
+    
+    for (p = job->proc ; p ; p = p->next)
+        
+        if (p->threaded)
+            p->interrupted = 1;
+    
+}
+
+void join_stages(Job * job) {
+    Process * p;
+    
+    for (p = job->proc ; p ; p = p->next)
+        
+        if (p->threaded) {
+            pthread_join(p->thread, NULL);
+            p->threaded = 0;
+        }
+    
+}
+
 void analyce_job_status(Job * job) {
     char signaled;
     Process * p = job->proc;
@@ -379,6 +456,23 @@ void analyce_job_status(Job * job) {
     
 }
 
+Job * search_job_by_proc(ListJobs jobs, Process * proc) {
+    Job * curr = jobs;
+    Process * p;
+    
+    while (curr) {
+        
+        for (p = curr->proc ; p ; p = p->next)
+            
+            if (p == proc)
+                return curr;
+        
+        curr = curr->next;
+    }
+    
+    return NULL;
+}
+
 Job * search_job_by_process(ListJobs jobs, pid_t pid) {
     Job * j = NULL;
     Job * curr = jobs;
@@ -413,3 +507,99 @@ void kill_job(Job * job, int n, int sig) {
     }
     
 }
+
+char add_job_dependency(Job * job, Job * dep) {
+    
+    if (job->ndeps >= MAX_DEPS)
+        return 0;
+    
+    job->deps[job->ndeps] = dep;
+    job->ndeps++;
+    
+    return 1;
+}
+
+void resolve_job_dependency(ListJobs jobs, Job * done) {
+    Job * j;
+    char success, found;
+    int i;
+    
+    success = done->status == COMPLETED && *(done->info) == 0;
+    
+    for (j = jobs ; j ; j = j->next) {
+        
+        if (j->status != WAITING)
+            continue;
+        
+        found = 0;
+        i = 0;
+        
+        while (i < j->ndeps) {
+            
+            if (j->deps[i] == done) { // Se sustituye por la última.
+                j->ndeps--;
+                j->deps[i] = j->deps[j->ndeps];
+                found = 1;
+            }
+            else
+                i++;
+            
+        }
+        
+        // Si falló, se cancela y se propaga a los que dependen de este.
+        if (found && !success) {
+            j->ndeps = 0;
+            j->status = CANCELLED;
+            resolve_job_dependency(jobs, j);
+        }
+        
+    }
+    
+}
+
+Job * next_ready_job(ListJobs jobs) {
+    
+    while (jobs && !(jobs->status == WAITING && jobs->ndeps == 0))
+        jobs = jobs->next;
+    
+    return jobs;
+}
+
+int count_background_jobs(ListJobs jobs) {
+    int total = 0;
+    
+    for (; jobs ; jobs = jobs->next)
+        
+        if (!jobs->foreground && jobs->gpid > 0 && 
+            (jobs->status == RUNNING || jobs->status == STOPPED))
+            total++;
+    
+    return total;
+}
+
+void enqueue_job(Job * job) {
+    job->status = QUEUED;
+    job->ticket = next_ticket++;
+}
+
+Job * next_queued_job(ListJobs jobs) {
+    Job * first = NULL;
+    
+    for (; jobs ; jobs = jobs->next)
+        
+        if (jobs->status == QUEUED && (!first || jobs->ticket < first->ticket))
+            first = jobs;
+    
+    return first;
+}
+
+int queue_position(ListJobs jobs, Job * job) {
+    int pos = 1;
+    
+    for (; jobs ; jobs = jobs->next)
+        
+        if (jobs->status == QUEUED && jobs->ticket < job->ticket)
+            pos++;
+    
+    return pos;
+}
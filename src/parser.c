@@ -0,0 +1,226 @@
+/**
+ * Implementación del analizador de la línea de comandos.
+ *
+ * @file  parser.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <parser.h>
+#include <scan.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+
+#define SEPARATORS " |&+>"
+
+static void init_stage(Stage * st) {
+    st->argc = 0;
+    st->outfile.str = NULL;
+    st->outfile.len = 0;
+}
+
+/**
+ * Pasa a la siguiente etapa de la tubería. Las etapas vacías se reutilizan.
+ */
+
+static void next_stage(CommandLine * cl) {
+    Stage * st = &cl->stages[cl->nstages - 1];
+    
+    if (st->argc == 0 && st->outfile.len == 0)
+        return;
+    
+    if (cl->nstages == MAX_STAGES) {
+        cl->overflow = 1;
+        return;
+    }
+    
+    init_stage(&cl->stages[cl->nstages++]);
+}
+
+/**
+ * Añade una palabra a la etapa actual, como argumento o como fichero de la
+ * redirección si la precedía un '>'.
+ */
+
+static void add_word(CommandLine * cl, Token tok, char * redirect) {
+    Stage * st = &cl->stages[cl->nstages - 1];
+    
+    if (*redirect) {
+        
+        if (st->outfile.len)
+            cl->size -= st->outfile.len + 1;
+        
+        st->outfile = tok;
+        *redirect = 0;
+    }
+    else if (st->argc < MAX_ARGS)
+        st->args[st->argc++] = tok;
+    else {
+        cl->overflow = 1;
+        return;
+    }
+    
+    cl->size += tok.len + 1;
+}
+
+/**
+ * Lee una palabra. Si empieza por comillas llega hasta las siguientes, que
+ * forman parte de ella; si no, hasta el siguiente separador.
+ *
+ * @return  Posición siguiente a la palabra.
+ */
+
+static const char * scan_word(const char * p, Token * tok) {
+    char del[2] = {0, 0};
+    
+    tok->str = p;
+    
+    if (*p == '\'' || *p == '\"') {
+        del[0] = *p;
+        p = scan_any(p + 1, del);
+        
+        if (*p)
+            p++;
+    }
+    else
+        p = scan_any(p, SEPARATORS);
+        
+    tok->len = p - tok->str;
+    
+    return p;
+}
+
+/**
+ * Lee el número de una referencia al historial, tras la palabra historial.
+ *
+ * @param p   Posición siguiente a la palabra historial.
+ * @param n   Aquí se deja el número.
+ * @return    Posición siguiente al número, o NULL si no lo hay.
+ */
+
+static const char * history_number(const char * p, int * n) {
+    const char * start;
+    
+    while (*p == ' ')
+        p++;
+    
+    for (start = p ; isdigit(*p) ; p++);
+    
+    if (p == start || !strchr(SEPARATORS, *p))
+        return NULL;
+    
+    *n = atoi(start);
+    
+    return p;
+}
+
+static void lex(const char * p, CommandLine * cl, HistoryLookup lookup, void * ctx) {
+    const char * next, * text;
+    char redirect = 0;
+    Token tok;
+    int n;
+    
+    while (*p) {
+        
+        switch (*p) {
+            
+            case ' ':
+                p++;
+                break;
+                
+            case '|':
+                next_stage(cl);
+                p++;
+                break;
+                
+            case '&':
+                cl->background = 1;
+                p++;
+                break;
+                
+            case '+':
+                cl->respawnable = 1;
+                p++;
+                break;
+                
+            case '>':
+                redirect = 1;
+                p++;
+                break;
+                
+            default:
+                p = scan_word(p, &tok);
+                
+                // Las entradas guardadas ya están expandidas: no se vuelve a expandir.
+                if (lookup && tok.len == strlen(CMDHIST) && !strncmp(tok.str, CMDHIST, tok.len) &&
+                    (next = history_number(p, &n)) && (text = lookup(n, ctx))) {
+                    cl->expanded = 1;
+                    lex(text, cl, NULL, NULL);
+                    p = next;
+                }
+                else
+                    add_word(cl, tok, &redirect);
+                
+        }
+    }
+    
+}
+
+void parse_line(const char * line, CommandLine * cl, HistoryLookup lookup, void * ctx) {
+    cl->nstages = 1;
+    cl->background = cl->respawnable = cl->expanded = cl->overflow = cl->borrowed = 0;
+    cl->size = 0;
+    init_stage(&cl->stages[0]);
+    
+    lex(line, cl, lookup, ctx);
+    
+    // Una tubería acabada en '|' no deja una etapa vacía al final.
+    if (cl->nstages > 1 && cl->stages[cl->nstages - 1].argc == 0)
+        cl->nstages--;
+}
+
+static int put(char * buff, int size, int n, const char * str, int len) {
+    
+    if (n + len < size)
+        memcpy(buff + n, str, len);
+    
+    return n + len;
+}
+
+int unparse_line(const CommandLine * cl, char * buff, int size) {
+    const Stage * st;
+    int i, j, n = 0;
+    
+    for (i = 0 ; i < cl->nstages ; i++) {
+        st = &cl->stages[i];
+        
+        if (i > 0)
+            n = put(buff, size, n, " | ", 3);
+        
+        for (j = 0 ; j < st->argc ; j++) {
+            
+            if (j > 0)
+                n = put(buff, size, n, " ", 1);
+            
+            n = put(buff, size, n, st->args[j].str, st->args[j].len);
+        }
+        
+        if (st->outfile.len) {
+            n = put(buff, size, n, " > ", 3);
+            n = put(buff, size, n, st->outfile.str, st->outfile.len);
+        }
+    }
+    
+    if (cl->respawnable)
+        n = put(buff, size, n, " +", 2);
+    else if (cl->background)
+        n = put(buff, size, n, " &", 2);
+    
+    if (n >= size)
+        return -1;
+    
+    buff[n] = '\0';
+    
+    return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * Implementación del árbol de prefijos del historial.
+ * 
+ * @file  prefix_trie.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <prefix_trie.h>
+#include <defs.h>
+#include <stdlib.h>
+#include <string.h>
+
+void initTrie(PrefixTrie * trie) {
+    trie->c = '\0';
+    trie->child = NULL;
+    trie->sibling = NULL;
+    trie->count = trie->size = 0;
+    trie->nums = NULL;
+    trie->truncated = 0;
+}
+
+/**
+ * Devuelve el hijo de un nodo con el carácter c, creándolo si no existe.
+ */
+
+static TrieNode * childOf(TrieNode * node, char c) {
+    TrieNode * child;
+    
+    for (child = node->child ; child && child->c != c ; child = child->sibling);
+    
+    if (!child) {
+        child = (TrieNode *) malloc(sizeof(TrieNode));
+        initTrie(child);
+        child->c = c;
+        child->sibling = node->child;
+        node->child = child;
+    }
+    
+    return child;
+}
+
+void addPrefixes(PrefixTrie * trie, int n, const char * text, int len) {
+    TrieNode * node = trie;
+    int i;
+    
+    for (i = 0 ; i < len && i < HIST_PREFIX_DEPTH ; i++) {
+        node = childOf(node, text[i]);
+        
+        while (node->count > 0 && node->nums[node->count - 1] > n)
+            node->count--;
+        
+        if (node->count > 0 && node->nums[node->count - 1] == n)
+            continue;
+        
+        // Llena, se descarta la más antigua: acota la memoria en los prefijos comunes.
+        if (node->count == HIST_PREFIX_POSTINGS) {
+            memmove(node->nums, node->nums + 1, (node->count - 1) * sizeof(int));
+            node->count--;
+            node->truncated = 1;
+        }
+        
+        if (node->count == node->size) {
+            node->size = node->size ? 2 * node->size : 4;
+            node->nums = (int *) realloc(node->nums, node->size * sizeof(int));
+        }
+        
+        node->nums[node->count++] = n;
+    }
+    
+}
+
+/**
+ * Pone delante de la lista de un nodo las entradas más recientes de la de
+ * otro, que son anteriores, hasta llenarla.
+ */
+
+static void prependNums(TrieNode * node, const TrieNode * older) {
+    int take = HIST_PREFIX_POSTINGS - node->count;
+    
+    if (take > older->count)
+        take = older->count;
+    
+    if (take < older->count || older->truncated)
+        node->truncated = 1;
+    
+    if (take == 0)
+        return;
+    
+    if (node->count + take > node->size) {
+        node->size = node->count + take;
+        node->nums = (int *) realloc(node->nums, node->size * sizeof(int));
+    }
+    
+    memmove(node->nums + take, node->nums, node->count * sizeof(int));
+    memcpy(node->nums, older->nums + older->count - take, take * sizeof(int));
+    node->count += take;
+}
+
+/**
+ * Une los hijos de older a los de node. Los que no existen en node se mueven
+ * enteros; los demás se unen y se liberan.
+ */
+
+static void mergeNodes(TrieNode * node, TrieNode * older) {
+    TrieNode * child, * next, ** link;
+    
+    prependNums(node, older);
+    
+    for (child = older->child ; child ; child = next) {
+        next = child->sibling;
+        
+        for (link = &node->child ; *link && (*link)->c != child->c ; link = &((*link)->sibling));
+        
+        if (!*link) {
+            child->sibling = node->child;
+            node->child = child;
+        }
+        else {
+            mergeNodes(*link, child);
+            free(child->nums);
+            free(child);
+        }
+    }
+    
+    older->child = NULL;
+}
+
+void mergePrefixes(PrefixTrie * trie, PrefixTrie * older) {
+    mergeNodes(trie, older);
+    destroyTrie(older);
+}
+
+const TrieNode * findPrefix(PrefixTrie * trie, const char * prefix, int len) {
+    const TrieNode * node = trie;
+    int i;
+    
+    for (i = 0 ; node && i < len && i < HIST_PREFIX_DEPTH ; i++)
+        for (node = node->child ; node && node->c != prefix[i] ; node = node->sibling);
+    
+    return node && (node->count > 0 || node->truncated) ? node : NULL;
+}
+
+/**
+ * Libera los hijos de un nodo, y sus hermanos.
+ */
+
+static void destroyNodes(TrieNode * node) {
+    TrieNode * next;
+    
+    for (; node ; node = next) {
+        next = node->sibling;
+        destroyNodes(node->child);
+        free(node->nums);
+        free(node);
+    }
+    
+}
+
+void destroyTrie(PrefixTrie * trie) {
+    destroyNodes(trie->child);
+    free(trie->nums);
+    initTrie(trie);
+}
@@ -0,0 +1,67 @@
+/**
+ * Implementación de la lectura de la presión del sistema.
+ * 
+ * @file  pressure.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <pressure.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define PSI_CPU    "/proc/pressure/cpu"
+#define PSI_MEMORY "/proc/pressure/memory"
+#define LOADAVG    "/proc/loadavg"
+
+/**
+ * Lee un fichero pequeño de /proc en el buffer pasado como argumento. Se usa
+ * read en vez de stdio, porque se llama desde el manejador de SIGALRM.
+ * 
+ * @param path  Ruta del fichero.
+ * @param buff  Buffer destino.
+ * @param size  Tamaño del buffer.
+ * @return      Número de bytes leidos, o -1 si hubo algún error.
+ */
+
+static int read_proc(const char * path, char * buff, int size) {
+    int fd, n;
+    
+    if ( (fd = open(path, O_RDONLY)) < 0 )
+        return -1;
+    
+    n = read(fd, buff, size - 1);
+    close(fd);
+    
+    if (n >= 0)
+        buff[n] = '\0';
+    
+    return n;
+}
+
+static double read_loadavg() {
+    char buff[128];
+    long cpus;
+    
+    if (read_proc(LOADAVG, buff, sizeof(buff)) <= 0)
+        return -1;
+    
+    if ( (cpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1 )
+        cpus = 1;
+    
+    return atof(buff) * 100 / cpus;
+}
+
+double read_pressure(Resource res) {
+    char buff[256];
+    char * avg;
+    
+    if (read_proc(res == PRESSURE_CPU ? PSI_CPU : PSI_MEMORY, buff, sizeof(buff)) <= 0 ||
+        strncmp(buff, "some", 4) != 0 || !(avg = strstr(buff, "avg10=")))
+        return res == PRESSURE_CPU ? read_loadavg() : -1;
+    
+    return atof(avg + strlen("avg10="));
+}
@@ -0,0 +1,128 @@
+/**
+ * Implementación de la búsqueda de delimitadores.
+ * 
+ * Las versiones vectoriales leen bloques alineados, así que nunca cruzan una
+ * página que no contenga parte de la cadena; los bytes del primer bloque que
+ * quedan antes de la cadena se descartan con una máscara.
+ * 
+ * @file  scan.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <scan.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static const char * scan_resolve(const char * p, const char * set);
+
+// Versión en uso; la primera llamada la elige.
+static const char * (*scan_impl)(const char *, const char *) = scan_resolve;
+
+static const char * scan_scalar(const char * p, const char * set) {
+    
+    while (*p && !strchr(set, *p))
+        p++;
+    
+    return p;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("sse2")))
+static const char * scan_sse2(const char * p, const char * set) {
+    const char * block = (const char *) ((uintptr_t) p & ~(uintptr_t) 15);
+    __m128i needle[SCAN_SET_MAX + 1];
+    __m128i chunk, hit;
+    unsigned mask = ~0u << (p - block);
+    int i, n;
+    
+    for (n = 0 ; set[n] && n < SCAN_SET_MAX ; n++)
+        needle[n] = _mm_set1_epi8(set[n]);
+    
+    needle[n++] = _mm_setzero_si128();  // El '\0' final siempre se busca.
+    
+    while (1) {
+        chunk = _mm_load_si128((const __m128i *) block);
+        hit = _mm_cmpeq_epi8(chunk, needle[0]);
+        
+        for (i = 1 ; i < n ; i++)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, needle[i]));
+        
+        mask &= (unsigned) _mm_movemask_epi8(hit);
+        
+        if (mask)
+            return block + __builtin_ctz(mask);
+        
+        block += 16;
+        mask = ~0u;
+    }
+}
+
+__attribute__((target("avx2")))
+static const char * scan_avx2(const char * p, const char * set) {
+    const char * block = (const char *) ((uintptr_t) p & ~(uintptr_t) 31);
+    __m256i needle[SCAN_SET_MAX + 1];
+    __m256i chunk, hit;
+    unsigned mask = ~0u << (p - block);
+    int i, n;
+    
+    for (n = 0 ; set[n] && n < SCAN_SET_MAX ; n++)
+        needle[n] = _mm256_set1_epi8(set[n]);
+    
+    needle[n++] = _mm256_setzero_si256();
+    
+    while (1) {
+        chunk = _mm256_load_si256((const __m256i *) block);
+        hit = _mm256_cmpeq_epi8(chunk, needle[0]);
+        
+        for (i = 1 ; i < n ; i++)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(chunk, needle[i]));
+        
+        mask &= (unsigned) _mm256_movemask_epi8(hit);
+        
+        if (mask)
+            return block + __builtin_ctz(mask);
+        
+        block += 32;
+        mask = ~0u;
+    }
+}
+
+#endif /* SCAN_X86 */
+
+ScanLevel scan_select(ScanLevel level) {
+    
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    
+    if (level >= SCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+        scan_impl = scan_avx2;
+        return SCAN_AVX2;
+    }
+    
+    if (level >= SCAN_SSE2 && __builtin_cpu_supports("sse2")) {
+        scan_impl = scan_sse2;
+        return SCAN_SSE2;
+    }
+#endif
+
+    scan_impl = scan_scalar;
+    
+    return SCAN_SCALAR;
+}
+
+static const char * scan_resolve(const char * p, const char * set) {
+    scan_select(SCAN_AVX2);
+    
+    return scan_impl(p, set);
+}
+
+const char * scan_any(const char * p, const char * set) {
+    return scan_impl(p, set);
+}
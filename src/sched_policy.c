@@ -0,0 +1,278 @@
+/**
+ * Implementación de las políticas de planificación.
+ * 
+ * @file  sched_policy.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#define _GNU_SOURCE
+#include <sched_policy.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+// glibc no exporta ioprio_set, así que se definen aquí sus constantes.
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_NONE   0
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_VALUE(c,d)   (((c) << 13) | (d))
+
+#define BG_NICE_VALUE 10
+
+static int set_ioprio(pid_t pid, int class, int data) {
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid, IOPRIO_VALUE(class, data));
+}
+
+void lower_priority(pid_t pid, BgPriority prio) {
+    struct sched_param param = { .sched_priority = 0 };
+    
+    switch (prio) {
+        
+        case BG_BATCH:
+            sched_setscheduler(pid, SCHED_BATCH, &param);
+            // Sigue con BG_NICE.
+            __attribute__((fallthrough));
+            
+        case BG_NICE:
+            setpriority(PRIO_PROCESS, pid, BG_NICE_VALUE);
+            set_ioprio(pid, IOPRIO_CLASS_BE, 7);
+            break;
+            
+        case BG_IDLE:
+            sched_setscheduler(pid, SCHED_IDLE, &param);
+            set_ioprio(pid, IOPRIO_CLASS_IDLE, 0);
+            break;
+            
+        case BG_NORMAL:
+            break;
+    }
+    
+}
+
+/**
+ * Devuelve el nice más bajo que RLIMIT_NICE permite fijar sin CAP_SYS_NICE.
+ */
+
+static int nice_floor() {
+    struct rlimit rl;
+    
+    if (getrlimit(RLIMIT_NICE, &rl) < 0)
+        return 20;
+    
+    if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= 40)
+        return -20;
+    
+    return 20 - (int) rl.rlim_cur;
+}
+
+int restore_priority(pid_t pid) {
+    struct sched_param param = { .sched_priority = 0 };
+    int error = 0, floor, current;
+    
+    // Primero el nice: para salir de SCHED_IDLE sin privilegios tiene que
+    // estar dentro de RLIMIT_NICE. Sin permiso, se baja hasta donde se pueda.
+    if (setpriority(PRIO_PROCESS, pid, 0) < 0) {
+        
+        if (errno != EACCES && errno != EPERM)
+            error = 1;
+        else if ((floor = nice_floor()) > 0) {
+            errno = 0;
+            current = getpriority(PRIO_PROCESS, pid);
+            
+            if (errno == 0 && floor < current)
+                setpriority(PRIO_PROCESS, pid, floor);
+        }
+    }
+    
+    if (sched_setscheduler(pid, SCHED_OTHER, &param) < 0 && errno != EPERM)
+        error = 1;
+    
+    if (set_ioprio(pid, IOPRIO_CLASS_NONE, 0) < 0 && errno != EPERM)
+        error = 1;
+    
+    return error ? -1 : 0;
+}
+
+struct CpuMask {
+    cpu_set_t set;
+};
+
+#define SIBLINGS_PATH "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list"
+
+static int compact_order[CPU_SETSIZE];     // CPUs con los hermanos juntos.
+static int spread_order[CPU_SETSIZE];      // Un hilo de cada núcleo, por turnos.
+static int ncpus = 0;
+
+CpuMask * parse_cpu_list(const char * list) {
+    CpuMask * mask = (CpuMask *) malloc(sizeof(CpuMask));
+    char * end;
+    long first, last;
+    
+    CPU_ZERO(&mask->set);
+    
+    do {
+        first = strtol(list, &end, 10);
+        last = first;
+        
+        if (end != list && *end == '-')
+            last = strtol(end + 1, &end, 10);
+        
+        if (end == list || first < 0 || last < first || last >= CPU_SETSIZE ||
+            (*end != ',' && *end != '\0')) {
+            free(mask);
+            return NULL;
+        }
+        
+        for (; first <= last ; first++)
+            CPU_SET(first, &mask->set);
+        
+        list = end + 1;
+    } while (*end == ',');
+    
+    return mask;
+}
+
+CpuMask * parse_cpu_hex(const char * hex) {
+    CpuMask * mask;
+    int len, i, bit, digit;
+    
+    if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+        hex += 2;
+    
+    if ( (len = strlen(hex)) == 0 )
+        return NULL;
+    
+    mask = (CpuMask *) malloc(sizeof(CpuMask));
+    CPU_ZERO(&mask->set);
+    
+    // El último dígito son las CPUs 0-3, el penúltimo las 4-7...
+    for (i = 0 ; i < len ; i++) {
+        
+        if (!isxdigit(hex[len - 1 - i])) {
+            free(mask);
+            return NULL;
+        }
+        
+        digit = isdigit(hex[len - 1 - i]) ? hex[len - 1 - i] - '0' : tolower(hex[len - 1 - i]) - 'a' + 10;
+        
+        for (bit = 0 ; bit < 4 ; bit++)
+            
+            if (digit & (1 << bit)) {
+                
+                if (4 * i + bit >= CPU_SETSIZE) {
+                    free(mask);
+                    return NULL;
+                }
+                
+                CPU_SET(4 * i + bit, &mask->set);
+            }
+    }
+    
+    if (CPU_COUNT(&mask->set) == 0) {
+        free(mask);
+        return NULL;
+    }
+    
+    return mask;
+}
+
+/**
+ * Construye el orden de las CPUs para cada política, a partir de las CPUs que
+ * tiene permitidas la shell y de los hermanos de cada una.
+ */
+
+static void load_topology() {
+    cpu_set_t allowed, seen;
+    CpuMask * siblings;
+    int groups[CPU_SETSIZE][2];          // Inicio y longitud de cada núcleo en compact_order.
+    int ngroups = 0, cpu, sib, i, round, added;
+    char path[128], list[256];
+    FILE * fich;
+    
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        return;
+    
+    CPU_ZERO(&seen);
+    
+    for (cpu = 0 ; cpu < CPU_SETSIZE ; cpu++) {
+        
+        if (!CPU_ISSET(cpu, &allowed) || CPU_ISSET(cpu, &seen))
+            continue;
+        
+        groups[ngroups][0] = ncpus;
+        siblings = NULL;
+        snprintf(path, sizeof(path), SIBLINGS_PATH, cpu);
+        
+        if ( (fich = fopen(path, "r")) ) {
+            
+            if (fgets(list, sizeof(list), fich)) {
+                list[strcspn(list, "\n")] = '\0';
+                siblings = parse_cpu_list(list);
+            }
+            
+            fclose(fich);
+        }
+        
+        // Sin topología, cada CPU es un núcleo.
+        for (sib = cpu ; sib < CPU_SETSIZE ; sib++) 
+            
+            if (CPU_ISSET(sib, &allowed) && !CPU_ISSET(sib, &seen) &&
+                (sib == cpu || (siblings && CPU_ISSET(sib, &siblings->set)))) {
+                CPU_SET(sib, &seen);
+                compact_order[ncpus++] = sib;
+            }
+        
+        groups[ngroups][1] = ncpus - groups[ngroups][0];
+        free(siblings);
+        ngroups++;
+    }
+    
+    // En spread se toma el primer hilo de cada núcleo, luego el segundo...
+    i = 0;
+    
+    for (round = 0, added = 1 ; added ; round++) {
+        added = 0;
+        
+        for (cpu = 0 ; cpu < ngroups ; cpu++)
+            
+            if (round < groups[cpu][1]) {
+                spread_order[i++] = compact_order[groups[cpu][0] + round];
+                added = 1;
+            }
+        
+    }
+    
+}
+
+CpuMask * policy_mask(AffinityPolicy policy, int unit) {
+    static CpuMask mask;
+    
+    if (policy == AFFINITY_NONE)
+        return NULL;
+    
+    if (ncpus == 0)
+        load_topology();
+    
+    if (ncpus == 0)
+        return NULL;
+    
+    CPU_ZERO(&mask.set);
+    
+    if (policy == AFFINITY_COMPACT)
+        CPU_SET(compact_order[unit % ncpus], &mask.set);
+    else
+        CPU_SET(spread_order[unit % ncpus], &mask.set);
+    
+    return &mask;
+}
+
+int apply_affinity(CpuMask * mask) {
+    return sched_setaffinity(0, sizeof(mask->set), &mask->set);
+}
@@ -0,0 +1,406 @@
+/**
+ * Implementación de la ejecución de ficheros de comandos.
+ * 
+ * La caché empieza por una cabecera (CacheHeader) seguida de un registro por
+ * comando:
+ * 
+ *   flags (1 byte) | nº de etapas (1) | por etapa: nº de argumentos (1) y
+ *   si hay redirección (1) | comando\0 | por etapa: argumentos\0... fichero\0
+ * 
+ * Todas las cadenas acaban en '\0', así que los trabajos pueden usarlas sin
+ * copiarlas.
+ * 
+ * @file  script.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <script.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define CACHE_EXT   ".shc"
+#define CACHE_MAGIC "SHC1"
+
+#define FLAG_BACKGROUND  1
+#define FLAG_RESPAWNABLE 2
+#define FLAG_OVERFLOW    4
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+typedef struct {
+    char magic[4];                  // CACHE_MAGIC.
+    uint32_t count;                 // Número de comandos.
+    uint64_t length;                // Tamaño de la caché, cabecera incluida.
+    uint64_t size;                  // Tamaño del fichero de comandos.
+    int64_t mtime_sec;              // Fecha de modificación del fichero.
+    int64_t mtime_nsec;
+    uint64_t hash;                  // FNV-1a del contenido del fichero.
+} CacheHeader;
+
+// Buffer que crece según se escribe la caché.
+typedef struct {
+    char * data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static uint64_t fnv1a(const char * data, size_t len) {
+    uint64_t h = FNV_OFFSET;
+    size_t i;
+    
+    for (i = 0 ; i < len ; i++)
+        h = (h ^ (unsigned char) data[i]) * FNV_PRIME;
+    
+    return h;
+}
+
+/**
+ * Lee el fichero entero en memoria, acabado en '\0'.
+ * 
+ * @return  Buffer (se libera con free), o NULL si hubo algún error.
+ */
+
+static char * read_all(const char * path, size_t size) {
+    char * text = malloc(size + 1);
+    size_t total = 0;
+    ssize_t n = 1;
+    int fd = open(path, O_RDONLY);
+    
+    if (fd < 0 || text == NULL) {
+        free(text);
+        
+        if (fd >= 0)
+            close(fd);
+        
+        return NULL;
+    }
+    
+    while (total < size && (n = read(fd, text + total, size - total)) > 0)
+        total += n;
+    
+    close(fd);
+    
+    if (n < 0) {
+        free(text);
+        return NULL;
+    }
+    
+    text[total] = '\0';
+    
+    return text;
+}
+
+static void put(Buffer * buf, const void * data, size_t len) {
+    
+    if (buf->len + len > buf->cap) {
+        
+        while (buf->len + len > buf->cap)
+            buf->cap *= 2;
+        
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void put_token(Buffer * buf, Token tok) {
+    put(buf, tok.str, tok.len);
+    put(buf, "", 1);
+}
+
+static void put_line(Buffer * buf, const char * cmd, const CommandLine * cl) {
+    unsigned char head[2 + 2 * MAX_STAGES];
+    const Stage * st;
+    Token tok = {cmd, strlen(cmd)};
+    int i, j, n = 0;
+    
+    head[n++] = (cl->background ? FLAG_BACKGROUND : 0) | (cl->respawnable ? FLAG_RESPAWNABLE : 0) |
+                (cl->overflow ? FLAG_OVERFLOW : 0);
+    head[n++] = cl->nstages;
+    
+    for (i = 0 ; i < cl->nstages ; i++) {
+        head[n++] = cl->stages[i].argc;
+        head[n++] = cl->stages[i].outfile.len > 0;
+    }
+    
+    put(buf, head, n);
+    put_token(buf, tok);
+    
+    for (i = 0 ; i < cl->nstages ; i++) {
+        st = &cl->stages[i];
+        
+        for (j = 0 ; j < st->argc ; j++)
+            put_token(buf, st->args[j]);
+        
+        if (st->outfile.len)
+            put_token(buf, st->outfile);
+    }
+}
+
+/**
+ * Analiza el fichero entero y deja la caché en sc. Las líneas vacías y las que
+ * empiezan por # no generan comando.
+ */
+
+static void compile(char * text, const struct stat * st, Script * sc) {
+    Buffer buf;
+    CacheHeader head;
+    CommandLine cl;
+    char * line, * end;
+    
+    memset(&head, 0, sizeof (head));
+    memcpy(head.magic, CACHE_MAGIC, sizeof (head.magic));
+    head.size = st->st_size;
+    head.mtime_sec = st->st_mtim.tv_sec;
+    head.mtime_nsec = st->st_mtim.tv_nsec;
+    head.hash = fnv1a(text, st->st_size);
+    
+    buf.cap = sizeof (head) + st->st_size * 2 + 64;
+    buf.data = malloc(buf.cap);
+    buf.len = sizeof (head);
+    
+    for (line = text ; *line ; line = end) {
+        
+        if ((end = strchr(line, '\n')))
+            *end++ = '\0';
+        else
+            end = line + strlen(line);
+        
+        parse_line(line, &cl, NULL, NULL);
+        
+        if (line[0] != '#' && (cl.overflow || cl.nstages > 1 || cl.stages[0].argc > 0)) {
+            put_line(&buf, line, &cl);
+            head.count++;
+        }
+    }
+    
+    head.length = buf.len;
+    memcpy(buf.data, &head, sizeof (head));
+    
+    sc->data = buf.data;
+    sc->length = buf.len;
+    sc->mapped = 0;
+}
+
+// Escribe la caché en un fichero temporal y lo renombra, para que nunca se lea a
+// medias. mkstemp crea un fichero nuevo, así que no sigue enlaces de otros.
+static void save_cache(const char * cache, const Script * sc) {
+    char tmp[PATH_MAX];
+    ssize_t n = 0;
+    size_t total = 0;
+    int fd;
+    
+    if (snprintf(tmp, PATH_MAX, "%s.XXXXXX", cache) >= PATH_MAX)
+        return;
+    
+    if ((fd = mkstemp(tmp)) < 0)
+        return;
+    
+    while (total < sc->length && (n = write(fd, sc->data + total, sc->length - total)) > 0)
+        total += n;
+    
+    close(fd);
+    
+    if (total < sc->length || rename(tmp, cache) < 0)
+        unlink(tmp);
+}
+
+/**
+ * Mapea la caché si corresponde al fichero de comandos. Si sólo ha cambiado la
+ * fecha de modificación y el contenido es el mismo, se actualiza la fecha
+ * guardada para no tener que volver a calcular el hash. Sólo se acepta una caché
+ * del propio usuario que no puedan escribir otros, porque sus comandos se
+ * ejecutan tal cual.
+ * 
+ * @return  0, o -1 si no hay caché válida.
+ */
+
+static int load_cache(const char * path, const char * cache, const struct stat * st, Script * sc) {
+    struct stat cst;
+    CacheHeader * head;
+    char * text;
+    int fd = open(cache, O_RDWR | O_NOFOLLOW);
+    char valid = 0;
+    
+    if (fd < 0 && (fd = open(cache, O_RDONLY | O_NOFOLLOW)) < 0)
+        return -1;
+    
+    if (fstat(fd, &cst) < 0 || !S_ISREG(cst.st_mode) || cst.st_uid != geteuid() ||
+        (cst.st_mode & (S_IWGRP | S_IWOTH)) || cst.st_size < (off_t) sizeof (CacheHeader)) {
+        close(fd);
+        return -1;
+    }
+    
+    // Privada y escribible: algunos comandos internos modifican sus argumentos.
+    sc->data = mmap(NULL, cst.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    sc->length = cst.st_size;
+    sc->mapped = 1;
+    
+    if (sc->data == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    
+    head = (CacheHeader *) sc->data;
+    
+    if (!memcmp(head->magic, CACHE_MAGIC, sizeof (head->magic)) && head->length == (uint64_t) cst.st_size &&
+        head->size == (uint64_t) st->st_size) {
+        
+        if (head->mtime_sec == st->st_mtim.tv_sec && head->mtime_nsec == st->st_mtim.tv_nsec)
+            valid = 1;
+        else if ((text = read_all(path, st->st_size))) {
+            valid = fnv1a(text, st->st_size) == head->hash;
+            free(text);
+            
+            if (valid) {
+                head->mtime_sec = st->st_mtim.tv_sec;
+                head->mtime_nsec = st->st_mtim.tv_nsec;
+                
+                // Si no se puede escribir, se volverá a comprobar el hash la próxima vez.
+                pwrite(fd, head, sizeof (CacheHeader), 0);
+            }
+        }
+    }
+    
+    close(fd);
+    
+    if (!valid) {
+        munmap(sc->data, sc->length);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int open_script(const char * path, Script * sc) {
+    char cache[PATH_MAX];
+    struct stat st;
+    char * text;
+    
+    if (stat(path, &st) < 0)
+        return -1;
+    
+    // Sin sitio para el nombre de la caché, se analiza cada vez.
+    if (snprintf(cache, PATH_MAX, "%s%s", path, CACHE_EXT) >= PATH_MAX || load_cache(path, cache, &st, sc) < 0) {
+        
+        if ((text = read_all(path, st.st_size)) == NULL)
+            return -1;
+        
+        compile(text, &st, sc);
+        free(text);
+        save_cache(cache, sc);
+    }
+    
+    sc->next = sc->data + sizeof (CacheHeader);
+    sc->left = ((CacheHeader *) sc->data)->count;
+    
+    return 0;
+}
+
+/**
+ * Toma una cadena de la caché.
+ * 
+ * @return  Posición siguiente a su '\0', o NULL si se sale de la caché.
+ */
+
+static const char * take_string(const char * p, const char * end, Token * tok) {
+    const char * nul = memchr(p, '\0', end - p);
+    
+    if (nul == NULL)
+        return NULL;
+    
+    tok->str = p;
+    tok->len = nul - p;
+    
+    return nul + 1;
+}
+
+int next_script_line(Script * sc, const char ** cmd, CommandLine * cl) {
+    const char * p = sc->next, * end = sc->data + sc->length;
+    unsigned char flags;
+    Stage * st;
+    Token tok;
+    int i, j;
+    
+    if (sc->left == 0)
+        return 0;
+    
+    if (end - p < 2)
+        return -1;
+    
+    flags = p[0];
+    cl->nstages = (unsigned char) p[1];
+    
+    if (cl->nstages < 1 || cl->nstages > MAX_STAGES || end - p < 2 + 2 * cl->nstages)
+        return -1;
+    
+    cl->background = (flags & FLAG_BACKGROUND) != 0;
+    cl->respawnable = (flags & FLAG_RESPAWNABLE) != 0;
+    cl->overflow = (flags & FLAG_OVERFLOW) != 0;
+    cl->expanded = 0;
+    cl->borrowed = 1;
+    cl->size = 0;
+    p += 2;
+    
+    // La redirección se marca con una longitud provisional hasta leer el nombre.
+    for (i = 0 ; i < cl->nstages ; i++, p += 2) {
+        
+        if ((unsigned char) p[0] > MAX_ARGS)
+            return -1;
+        
+        cl->stages[i].argc = (unsigned char) p[0];
+        cl->stages[i].outfile.str = NULL;
+        cl->stages[i].outfile.len = p[1];
+    }
+    
+    if ((p = take_string(p, end, &tok)) == NULL)
+        return -1;
+    
+    *cmd = tok.str;
+    
+    for (i = 0 ; i < cl->nstages ; i++) {
+        st = &cl->stages[i];
+        
+        for (j = 0 ; j < st->argc ; j++) {
+            
+            if ((p = take_string(p, end, &st->args[j])) == NULL)
+                return -1;
+            
+            cl->size += st->args[j].len + 1;
+        }
+        
+        if (st->outfile.len) {
+            
+            if ((p = take_string(p, end, &st->outfile)) == NULL)
+                return -1;
+            
+            cl->size += st->outfile.len + 1;
+        }
+    }
+    
+    sc->next = p;
+    sc->left--;
+    
+    return 1;
+}
+
+void close_script(Script * sc) {
+    
+    if (sc->mapped)
+        munmap(sc->data, sc->length);
+    else
+        free(sc->data);
+    
+    sc->data = NULL;
+    sc->left = 0;
+}
@@ -7,6 +7,7 @@
  */
 
 #include <shell.h>
+#include <pressure.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -19,10 +20,52 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
 
 void * thread_time_out(void *);
 
 void launch_job(Job * job);
+void launch_forked_job(Job * job);
+static void shift_args(Process * p, int n);
+static void wait_stages(Job * job);
+
+/**
+ * Envía una señal a todos los procesos de un trabajo: a su grupo o, sin control
+ * de trabajos (todos están en el grupo de la shell), a cada uno.
+ */
+
+static void signal_job(Job * job, int sig) {
+    Process * p;
+    
+    if (shell.job_control) {
+        kill(-job->gpid, sig);
+        return;
+    }
+    
+    for (p = job->proc ; p ; p = p->next)
+        
+        if (p->pid > 0 && (p->state == RUNNING || p->state == STOPPED))
+            kill(p->pid, sig);
+    
+}
+
+/**
+ * Espera a que cambie el estado de algún proceso del trabajo, como waitpid.
+ * Sin control de trabajos no hay grupo que esperar: se espera a sus procesos
+ * en marcha de uno en uno.
+ */
+
+static pid_t wait_job(Job * job, int * status) {
+    Process * p;
+    
+    if (shell.job_control)
+        return waitpid(-job->gpid, status, WUNTRACED);
+    
+    for (p = job->proc ; p && !(p->pid > 0 && p->state == RUNNING) ; p = p->next);
+    
+    return p ? waitpid(p->pid, status, WUNTRACED) : -1;
+}
 
 void control_signals(void (*handler)(int)) {
     signal(SIGQUIT, handler);
@@ -33,43 +76,57 @@ void control_signals(void (*handler)(int)) {
     signal(SIGTSTP, handler);
 }
 
-void print_job_state(int number, Job * job) {
+void print_job_state(FILE * out, int number, Job * job) {
+    char state[32];
     
-    printf("[%d]\t", number);
+    fprintf(out, "[%d]\t", number);
 
     
     if (job->respawnable) 
-        printf("%-15s","Respawnable");
+        fprintf(out, "%-15s","Respawnable");
     else
         switch (job->status) {
             
             case COMPLETED:
-                printf("%-15s","Hecho");
+                fprintf(out, "%-15s","Hecho");
                 break;
                 
             case STOPPED:
-                printf("%-15s","Detenido");
+                fprintf(out, "%-15s","Detenido");
                 break;
                 
             case RUNNING:
-                printf("%-15s","En ejecución");
+                fprintf(out, "%-15s","En ejecución");
                 break;
                 
             case SIGNALED:
-                printf("%-15s","Signaled");
+                fprintf(out, "%-15s","Signaled");
                 break;
                 
             case READY:
-                printf("%-15s","Ready");
+                fprintf(out, "%-15s","Ready");
+                break;
+                
+            case WAITING:
+                fprintf(out, "%-15s","Esperando");
+                break;
+                
+            case CANCELLED:
+                fprintf(out, "%-15s","Cancelado");
+                break;
+                
+            case QUEUED:
+                snprintf(state, sizeof(state), "En cola (%d)", queue_position(shell.jobs, job));
+                fprintf(out, "%-15s", state);
                 
         }
     
-    printf("\t%s ", job->command);
+    fprintf(out, "\t%s ", job->command);
     
     if (job->total > 1)
-        printf("{*%d}", job->total);
+        fprintf(out, "{*%d}", job->total);
     
-    putchar('\n');
+    fputc('\n', out);
 }
 
 void block_sig(int sig) {
@@ -88,11 +145,81 @@ void unblock_sig(int sig) {
     sigprocmask(SIG_UNBLOCK, &block_sigchld, NULL);
 }
 
+/**
+ * Indica si se puede lanzar otro trabajo en background sin superar el límite.
+ */
+
+static char has_free_slot() {
+    return shell.max_bg_jobs <= 0 || count_background_jobs(shell.jobs) < shell.max_bg_jobs;
+}
+
+/**
+ * Indica si la presión de CPU o de memoria supera los umbrales configurados.
+ */
+
+static char under_pressure() {
+    
+    if (shell.pressure_cpu > 0 && read_pressure(PRESSURE_CPU) >= shell.pressure_cpu)
+        return 1;
+    
+    if (shell.pressure_mem > 0 && read_pressure(PRESSURE_MEMORY) >= shell.pressure_mem)
+        return 1;
+    
+    return 0;
+}
+
+/**
+ * Indica si se puede lanzar ya un trabajo en background: tiene que haber hueco
+ * libre y el sistema no puede estar bajo presión.
+ */
+
+static char admit_background_job() {
+    return has_free_slot() && !under_pressure();
+}
+
+/**
+ * Programa SIGALRM para dentro de un segundo, si no lo estaba ya.
+ */
+
+static void arm_alarm() {
+    
+    if (!shell.sigalarm_on) {
+        alarm(1);
+        shell.sigalarm_on = 1;
+    }
+    
+}
+
+/**
+ * Lanza los trabajos cuyas dependencias ya se han cumplido, y ocupa los huecos
+ * libres con los trabajos de la cola, por orden de llegada.
+ */
+
+void dispatch_ready_jobs() {
+    Job * job;
+    
+    while ( (job = next_ready_job(shell.jobs)) ) {
+        job->status = READY;
+        launch_job(job);
+    }
+    
+    while ( (job = next_queued_job(shell.jobs)) && admit_background_job() ) {
+        job->status = READY;
+        launch_forked_job(job);
+    }
+    
+}
+
 void respawnd_job(Job * j) {
     Job * nj;
     
     block_sig(SIGCHLD);
     nj = create_job(&shell.jobs,j->command);
+    
+    // Se relanza con la misma prioridad y CPUs (prio, taskset).
+    nj->priority = j->priority;
+    nj->cpus = j->cpus;
+    j->cpus = NULL;
     remove_job(&shell.jobs, j->gpid);
     unblock_sig(SIGCHLD);
     launch_job(nj);
@@ -122,7 +249,13 @@ void cleanInnerJobs(Job * j) {
     unblock_sig(SIGALRM);
 }
 
-void roundRobin(int sig) {
+/**
+ * Da el turno al siguiente proceso de cada trabajo round robin.
+ * 
+ * @return  Número de trabajos round robin que siguen necesitando turnos.
+ */
+
+int roundRobin() {
     Job * j = shell.jobs;
     int current, next, updated = 0;
     
@@ -143,13 +276,94 @@ void roundRobin(int sig) {
             // comando round robin, y el último está parado, pero tiene planificada
             // la señal de terminar.
             else
-                kill(-j->gpid, SIGCONT);
+                signal_job(j, SIGCONT);
 
         
         j = j->next;
     }
     
-    if (updated)
+    return updated;
+}
+
+/**
+ * Revisa la presión del sistema: lanza los trabajos retenidos si ya ha bajado
+ * y, con pressure-stop, detiene el trabajo en background más reciente cuando la
+ * presión de memoria se mantiene PRESSURE_SUSTAIN segundos, y reanuda los
+ * detenidos, de uno en uno, cuando baja. Se reanuda primero el último que se
+ * detuvo: como se detienen del más nuevo al más antiguo, vuelven antes los
+ * trabajos más avanzados y se deshace el último paso si la presión vuelve.
+ * 
+ * @return  1 si hay que seguir revisándola.
+ */
+
+static char pressure_tick() {
+    static int stops = 0;             // Trabajos detenidos hasta ahora (orden de throttled).
+    Job * j, * last = NULL;
+    char pending = 0;
+    
+    if (shell.pressure_cpu <= 0 && shell.pressure_mem <= 0)
+        return 0;
+    
+    block_sig(SIGCHLD);
+    dispatch_ready_jobs();
+    
+    if (shell.pressure_stop && shell.pressure_mem > 0) {
+        
+        if (read_pressure(PRESSURE_MEMORY) >= shell.pressure_mem)
+            shell.mem_high++;
+        else
+            shell.mem_high = 0;
+        
+        if (shell.mem_high >= PRESSURE_SUSTAIN) {
+            
+            for (j = shell.jobs ; j ; j = j->next)
+                
+                if (is_job_background(j) && j->gpid > 0 && j->type == NORMAL_JOB)
+                    last = j;
+            
+            if (last) {
+                last->throttled = ++stops;
+                signal_job(last, SIGSTOP);
+            }
+            
+            shell.mem_high = 0;
+        }
+        else if (shell.mem_high == 0) {
+            
+            for (j = shell.jobs ; j ; j = j->next)
+                
+                if (j->throttled && (!last || j->throttled > last->throttled))
+                    last = j;
+            
+            if (last) {
+                last->throttled = 0;
+                signal_job(last, SIGCONT);
+            }
+            
+        }
+        
+        pending = count_background_jobs(shell.jobs) > 0;
+    }
+    
+    for (j = shell.jobs ; j && !pending ; j = j->next)
+        pending = j->status == QUEUED || j->throttled;
+    
+    unblock_sig(SIGCHLD);
+    
+    return pending;
+}
+
+/**
+ * Manejador de SIGALRM: planificación round robin y control de presión.
+ */
+
+void alarmTick(int sig) {
+    char again;
+    
+    again = roundRobin() > 0;
+    again = pressure_tick() || again;
+    
+    if (again)
         alarm(1);
     else
         shell.sigalarm_on = 0;
@@ -170,8 +384,12 @@ void updateJobs(int sig) {
         p = j->proc;
         
         while (p) {
-
-            pid = waitpid(p->pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
+            
+            // Los procesos que aún no se han lanzado no tienen pid.
+            if (p->pid > 0)
+                pid = waitpid(p->pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
+            else
+                pid = 0;
             
             if (pid > 0) {
                 mark_process(j, status, pid);
@@ -187,10 +405,13 @@ void updateJobs(int sig) {
         
         if (updated) {
             
+            if (IS_JOB_ENDED(j->status))
+                resolve_job_dependency(shell.jobs, j);
+            
             if (j->respawnable && j->status == COMPLETED) 
                 respawnd_job(j);
             
-            j->notify = ((j->status == STOPPED && j->type != RR_JOB) || IS_JOB_ENDED(j->status)) && 
+            j->notify = ((j->status == STOPPED && j->type != RR_JOB && !j->throttled) || IS_JOB_ENDED(j->status)) && 
                     !j->foreground && !j->respawnable;
             
         }
@@ -198,54 +419,90 @@ void updateJobs(int sig) {
         j = j->next;
     }
     
+    if (updated)
+        dispatch_ready_jobs();
 }
 
-void init_shell() {
+/**
+ * Inicia la shell.
+ * 
+ * @param job_control  1 para la shell interactiva. Con 0 (fichero de comandos)
+ *                     no hace falta una terminal: los trabajos se quedan en el
+ *                     grupo de la shell, que no toca la terminal ni las señales
+ *                     del teclado, como un sh no interactivo.
+ */
+
+void init_shell(char job_control) {
     shell.fdin = fileno(stdin);
     shell.pid = getpid();
-
-    // Comprobamos que podemos usar la entrada estándar como
-    // una terminal.
-    if (!isatty(shell.fdin)) {
-        perror("isatty(shell.fdin)");
-        exit(-1);
+    shell.job_control = job_control;
+    
+    if (job_control) {
+        
+        // Comprobamos que podemos usar la entrada estándar como
+        // una terminal.
+        if (!isatty(shell.fdin)) {
+            perror("isatty(shell.fdin)");
+            exit(-1);
+        }
+        
+        // establecemos el grupo para la terminal.
+        setpgid(shell.pid, shell.pid);
+        
+        // Obtenemos el control de la terminal.
+        tcsetpgrp(shell.fdin, shell.pid);
     }
 
-    // establecemos el grupo para la terminal.
-    setpgid(shell.pid, shell.pid);
-
-    // Obtenemos el control de la terminal.
-    tcsetpgrp(shell.fdin, shell.pid);
-
     // creamos el historial.
     initHist(&(shell.hist));
     
     // creamos la lista de trabajos.
     init_list_jobs(&shell.jobs);
-
-    // Obtengo las opciones actuales de la terminal.
-    tcgetattr(shell.fdin, &(shell.mode));
     
-    // Nos ponemos en nuestro propio grupo.
-    if ( setpgid(shell.pid, shell.pid) < 0) {
-        perror("setpgid");
-        exit(-1);
+    if (job_control) {
+        
+        // Obtengo las opciones actuales de la terminal.
+        tcgetattr(shell.fdin, &(shell.mode));
+        
+        // Nos ponemos en nuestro propio grupo.
+        if ( setpgid(shell.pid, shell.pid) < 0) {
+            perror("setpgid");
+            exit(-1);
+        }
+        
+        // Ignoramos todo.
+        control_signals(SIG_IGN);
     }
     
-    // Ignoramos todo.
-    control_signals(SIG_IGN);
-    
     // Manejamos la señal de SIGALARM.    
-    signal(SIGALRM, roundRobin);
+    signal(SIGALRM, alarmTick);
     shell.sigalarm_on = 0;
     
     // Manejamos la señal SIGCHLD
     signal(SIGCHLD, updateJobs);
+    
+    // Las etapas internas de una tubería escriben desde hilos de la shell: si
+    // el lector termina, reciben EPIPE en vez de matarla.
+    signal(SIGPIPE, SIG_IGN);
+    
+    shell.max_bg_jobs = MAX_BG_JOBS;
+    shell.pressure_cpu = 0;
+    shell.pressure_mem = 0;
+    shell.pressure_stop = 0;
+    shell.mem_high = 0;
+    shell.bg_priority = BG_NORMAL;
+    shell.affinity = AFFINITY_NONE;
+    shell.affinity_unit = 0;
+    shell.capture = 0;
+    shell.mux = 0;
+    init_outputs(&shell.outputs);
 }
 
 void destroy_shell() {
     destroyHist(&(shell.hist));
     destroy_list_jobs(&shell.jobs);
+    destroy_outputs(&shell.outputs);
+    destroyCompletion();
 }
 
 void report_job_foreground(Job * job) {
@@ -253,8 +510,7 @@ void report_job_foreground(Job * job) {
     print_info("Foreground job ... pid : %d, command : %s, ", job->gpid, job->command);
     
     if (job->status == STOPPED) {
-        tcgetattr(shell.fdin, &job->tmodes);
-        job->cargarModo = 1;
+        job->cargarModo = shell.job_control && tcgetattr(shell.fdin, &job->tmodes) == 0;
         job->foreground = 0;
         print_info("detenido\n");
     }
@@ -271,6 +527,48 @@ void report_job_foreground(Job * job) {
     }
 }
 
+/**
+ * Devuelve la política de prioridad que se aplica al trabajo en background.
+ */
+
+static BgPriority job_priority(Job * job) {
+    return job->priority >= 0 ? job->priority : shell.bg_priority;
+}
+
+/**
+ * Baja (background) o restaura (foreground) la prioridad de los procesos de un
+ * trabajo, según su política.
+ * 
+ * @param job         Trabajo.
+ * @param background  1 si el trabajo pasa a background.
+ */
+
+static void set_job_priority(Job * job, char background) {
+    BgPriority prio = job_priority(job);
+    Process * p;
+    char error = 0;
+    
+    if (prio == BG_NORMAL)
+        return;
+    
+    for (p = job->proc ; p ; p = p->next) {
+        
+        if (p->pid <= 0)
+            continue;
+        
+        if (background)
+            lower_priority(p->pid, prio);
+        else if (restore_priority(p->pid) < 0)
+            error = 1;
+        
+    }
+    
+    if (error) {
+        print_error("No se pudo restaurar la prioridad de \"%s\".\n", job->command);
+    }
+    
+}
+
 void put_job_foreground(Job * job) {
     int status;
     pid_t pid;
@@ -279,19 +577,23 @@ void put_job_foreground(Job * job) {
     block_sig(SIGCHLD);
     
     // Si se almacenó el modo en el que el comando se detuvo, se reestablece.
-    if ( job->cargarModo ) {
+    if ( job->cargarModo && shell.job_control ) {
         tcsetattr(shell.fdin, TCSADRAIN, &job->tmodes);
     }
     
     job->foreground = 1;
-    tcsetpgrp(shell.fdin, job->gpid);
+    job->throttled = 0;
+    set_job_priority(job, 0);
+    
+    if (shell.job_control)
+        tcsetpgrp(shell.fdin, job->gpid);
     
     // Si el trabajo se paró..
     if ( job->status == STOPPED) 
-        kill(-job->gpid, SIGCONT);    
+        signal_job(job, SIGCONT);
     
     do {
-        pid = waitpid(- job->gpid, &status, WUNTRACED);
+        pid = wait_job(job, &status);
         
         if (pid > 0) {
             mark_process(job, status, pid);
@@ -300,11 +602,23 @@ void put_job_foreground(Job * job) {
         
     } while ( job->status == RUNNING );
     
+    // Las etapas internas se esperan cuando acaban los procesos; si el trabajo
+    // se detuvo, siguen hasta que se vuelva a esperar.
+    if (IS_JOB_ENDED(job->status))
+        wait_stages(job);
+    
+    if (IS_JOB_ENDED(job->status))
+        resolve_job_dependency(shell.jobs, job);
+    
     report_job_foreground(job);
     unblock_sig(SIGCHLD);
     
-    tcsetpgrp(shell.fdin, shell.pid);
-    tcsetattr(shell.fdin, TCSANOW,&shell.mode);
+    if (shell.job_control) {
+        tcsetpgrp(shell.fdin, shell.pid);
+        tcsetattr(shell.fdin, TCSANOW,&shell.mode);
+    }
+    
+    dispatch_ready_jobs();
 }
 
 void put_job_background(Job * job) {
@@ -312,12 +626,18 @@ void put_job_background(Job * job) {
     if (job->status == STOPPED) {
         job->status = RUNNING;
         job->foreground = 0;
-        kill(- job->gpid, SIGCONT);
+        job->throttled = 0;
+        set_job_priority(job, 1);
+        signal_job(job, SIGCONT);
     }
     
     analyce_job_status(job);
     
-    if (!job->respawnable) {
+    if (job->output) {
+        print_info("Background job ... pid : %d, command : %s, salida : %d\n", job->gpid,
+                   job->command, job->output->id);
+    }
+    else if (!job->respawnable) {
         print_info("Background job ... pid : %d, command : %s\n", job->gpid, job->command);
     }
     else {
@@ -325,7 +645,40 @@ void put_job_background(Job * job) {
     }
 }
 
-void launch_process(Process * p, int infile, int outfile, pid_t gpid, char foreground) {
+/**
+ * Quita del proceso el prefijo "taskset <máscara>" o "taskset -c <cpus>" y
+ * devuelve la máscara. Como en taskset, sin -c es una máscara en hexadecimal.
+ * 
+ * @param p  Proceso que empieza por taskset.
+ * @return   Máscara de CPUs, o NULL si el formato no es válido.
+ */
+
+static CpuMask * strip_taskset(Process * p) {
+    CpuMask * mask;
+    int skip = p->argc > 1 && strcmp(p->args[1], "-c") == 0;
+    
+    if (p->argc < 3 + skip) {
+        print_error("Formato: taskset <máscara hex> <command> | taskset -c <cpus> <command>\n");
+        return NULL;
+    }
+    
+    if (skip && !(mask = parse_cpu_list(p->args[2]))) {
+        print_error("%s : lista de CPUs %s no válida.\n", CMDTASK, p->args[2]);
+        return NULL;
+    }
+    
+    if (!skip && !(mask = parse_cpu_hex(p->args[1]))) {
+        print_error("%s : máscara de CPUs %s no válida.\n", CMDTASK, p->args[1]);
+        return NULL;
+    }
+    
+    shift_args(p, 2 + skip);
+    
+    return mask;
+}
+
+void launch_process(Process * p, int infile, int outfile, int errfile, pid_t gpid,
+                    char foreground, BgPriority prio, CpuMask * mask) {
     pid_t pid;
     int icmd;
     int value_exit;
@@ -335,20 +688,41 @@ void launch_process(Process * p, int infile, int outfile, pid_t gpid, char foreg
     if (gpid <= 0)
         gpid = pid;
     
-    setpgid(pid, gpid);
-
-    if (foreground)
-        tcsetpgrp(shell.fdin, gpid);
+    if (shell.job_control) {
+        setpgid(pid, gpid);
+        
+        if (foreground)
+            tcsetpgrp(shell.fdin, gpid);
+    }
     
     signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
     control_signals(SIG_DFL);
     
+    if (prio != BG_NORMAL)
+        lower_priority(0, prio);
+    
+    // Una etapa de la tubería puede fijar su propia afinidad: "... | taskset -c 2 cmd".
+    while (p->argc > 0 && strcmp(p->args[0], CMDTASK) == 0) 
+        
+        if ( !(mask = strip_taskset(p)) )
+            exit(EX_USAGE);
+    
+    if (mask && apply_affinity(mask) < 0) {
+        print_errno("sched_setaffinity");
+    }
+    
     // configuración de la entrada.
     if (infile != shell.fdin) {
        dup2(infile, shell.fdin);
        close(infile);
     }
     
+    // La salida de error capturada se cierra sola en el exec (O_CLOEXEC), pero
+    // hay que duplicarla antes de cerrar la estándar, que puede ser la misma.
+    if (errfile != STDERR_FILENO)
+        dup2(errfile, STDERR_FILENO);
+    
     if (outfile != STDOUT_FILENO) {
         dup2(outfile, STDOUT_FILENO);
         close(outfile);
@@ -364,22 +738,224 @@ void launch_process(Process * p, int infile, int outfile, pid_t gpid, char foreg
     } // Si es interno, se ejecuta el manejador.
     else {
         ICMD_HANDLER(icmd)(p);
-        value_exit = 0;
+        value_exit = p->info;
     }
     
     exit(value_exit);
 }
 
+/**
+ * Compone la etiqueta de las líneas de un trabajo multiplexado: su número en
+ * jobs y el comando, sin el & final.
+ */
+
+static char * mux_tag(Job * job, char * tag) {
+    Job * j;
+    int number = 1, len = strlen(job->command);
+    
+    for (j = shell.jobs ; j && j != job ; j = j->next)
+        
+        if (!j->foreground)
+            number++;
+    
+    while (len > 0 && (job->command[len-1] == '&' || job->command[len-1] == ' '))
+        len--;
+    
+    snprintf(tag, MUX_TAG, "[%d] %.*s: ", number, len, job->command);
+    
+    return tag;
+}
+
+// Etapa interna de una tubería que se ejecuta en un hilo.
+typedef struct {
+    Process * p;
+    void (*handler)(Process *);
+    char * text;                    // Salida ya generada, o NULL si la genera el hilo.
+    size_t len;
+} StageWork;
+
+/**
+ * Indica si una etapa se ejecuta en un hilo de la shell en lugar de en un
+ * proceso: los comandos internos que no se ejecutan en la propia shell, en
+ * trabajos normales en primer plano y sin time-out. En background se siguen
+ * creando procesos, que avisan al terminar con SIGCHLD.
+ */
+
+static char runs_on_thread(Job * job, Process * p) {
+    int index;
+    
+    if (!job->foreground || job->time_out != 0 || job->type != NORMAL_JOB || p->argc == 0)
+        return 0;
+    
+    index = indexOfInternalProcess(p);
+    
+    // Un sleep solo crea un proceso, para que Ctrl-Z pueda detenerlo (ver runs_inline).
+    if (index == cmd_sleep && !job->proc->next)
+        return 0;
+    
+    return index >= 0 && ICMD_HANDLER(index) && ICMD_FORK(index);
+}
+
+/**
+ * Abre la salida de una etapa que se ejecutará en un hilo: el fichero de la
+ * redirección, el extremo de la tubería o una copia de la salida estándar (que
+ * el hilo puede cerrar). Se cierran en el exec, para que no las hereden las
+ * etapas que se crean después y su lector vea el final.
+ * 
+ * @param p        Etapa.
+ * @param outfile  Descriptor de su salida, que pasa a ser de la etapa.
+ */
+
+static void open_stage_output(Process * p, int outfile) {
+    
+    if (p->outfile) {
+        
+        if (outfile != STDOUT_FILENO)
+            close(outfile);
+        
+        p->out = fopen(p->outfile, "we");
+    }
+    else {
+        
+        if (outfile == STDOUT_FILENO)
+            outfile = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        else
+            fcntl(outfile, F_SETFD, FD_CLOEXEC);
+        
+        p->out = outfile >= 0 ? fdopen(outfile, "w") : NULL;
+    }
+    
+    // En el estado del trabajo sólo cuentan sus procesos.
+    p->state = COMPLETED;
+    
+    if (p->out)
+        p->threaded = 1;
+    else {
+        print_errno("fopen");
+        p->out = stdout;
+        p->info = errno;
+    }
+    
+}
+
+static void * stage_thread(void * arg) {
+    StageWork * work = (StageWork *) arg;
+    Process * p = work->p;
+    
+    if (work->text)
+        fwrite(work->text, 1, work->len, p->out);
+    else
+        work->handler(p);
+    
+    fclose(p->out);  // Si el lector ya terminó, la salida se pierde (EPIPE).
+    p->out = stdout;
+    free(work->text);
+    free(work);
+    
+    return NULL;
+}
+
+/**
+ * Lanza los hilos de las etapas internas, cuando ya se han creado todos los
+ * procesos del trabajo. Los comandos que leen el estado de la shell (jobs,
+ * historial...) se escriben antes en memoria desde el hilo principal, y su
+ * hilo sólo vuelca el texto; los demás (ICMD_INLINE) se ejecutan en el hilo.
+ */
+
+static void start_stages(Job * job) {
+    sigset_t all, old;
+    StageWork * work;
+    FILE * mem, * out;
+    Process * p;
+    int index;
+    
+    // Los hilos heredan la máscara: las señales las atiende el hilo principal.
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    
+    for (p = job->proc ; p ; p = p->next) {
+        
+        if (!p->threaded)
+            continue;
+        
+        index = indexOfInternalProcess(p);
+        work = (StageWork *) malloc(sizeof (StageWork));
+        work->p = p;
+        work->handler = ICMD_HANDLER(index);
+        work->text = NULL;
+        
+        if (!ICMD_INLINE(index) && (mem = open_memstream(&work->text, &work->len))) {
+            out = p->out;
+            p->out = mem;
+            work->handler(p);
+            fclose(mem);
+            p->out = out;
+        }
+        
+        // Si no se puede crear el hilo, la etapa se ejecuta aquí.
+        if (pthread_create(&p->thread, NULL, stage_thread, work) != 0) {
+            stage_thread(work);
+            p->threaded = 0;
+        }
+    }
+    
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static Job * waiting_job;           // Trabajo cuyas etapas internas espera wait_stages.
+
+static void on_stage_interrupt(int sig) {
+    interrupt_stages(waiting_job);
+}
+
+/**
+ * Espera a las etapas internas de un trabajo en primer plano. Mientras, Ctrl-C
+ * interrumpe las que estén en un sleep; si el resto de la tubería murió por
+ * una señal, se interrumpen directamente.
+ */
+
+static void wait_stages(Job * job) {
+    void (*old)(int);
+    Process * p;
+    
+    for (p = job->proc ; p && !p->threaded ; p = p->next);
+    
+    if (!p)
+        return;
+    
+    if (shell.job_control)
+        tcsetpgrp(shell.fdin, shell.pid);  // Para que Ctrl-C llegue a la shell.
+    
+    if (job->status == SIGNALED)
+        interrupt_stages(job);
+    
+    waiting_job = job;
+    old = signal(SIGINT, on_stage_interrupt);
+    join_stages(job);
+    signal(SIGINT, old);
+}
+
 void launch_forked_job(Job * job) {
     Process * p = job->proc;
     pthread_t tid;
     int fdp[2];
     int outfile, infile;
+    int capture = -1, errfile = STDERR_FILENO;
+    char tag[MUX_TAG];
     FILE * fich;
+    CpuMask * mask;
     
     outfile = STDOUT_FILENO;
     infile  = shell.fdin;
     
+    // La salida de los trabajos en background capturados va a su buffer: la
+    // estándar, de la última etapa, y la de error, de todas.
+    if (!job->foreground && (job->capture || shell.capture) &&
+        (job->output = create_output(&shell.outputs, job->command, &capture)))
+        errfile = capture;
+    else if (!job->foreground && shell.mux && (capture = mux_attach(mux_tag(job, tag))) >= 0)
+        errfile = capture;
+    
     while (p) {
         
         // Configuración de pipes y ficheros.
@@ -390,28 +966,42 @@ void launch_forked_job(Job * job) {
                 exit(1);
             }
             else {
+                // El escritor no se queda con el extremo de lectura: si el
+                // lector no lee (o es un hilo que lo cerró), recibe EPIPE.
+                fcntl(fdp[0], F_SETFD, FD_CLOEXEC);
                 outfile = fdp[1];
             }
         
+        else if (capture >= 0)
+            outfile = capture;
         else
             outfile = STDOUT_FILENO;
         
-        p->pid = fork(); 
+        // La máscara del trabajo tiene preferencia sobre la política. El reparto
+        // continúa donde lo dejó el trabajo anterior, para que trabajos
+        // independientes no compartan CPU.
+        mask = job->cpus;
         
-        if (p->pid == 0)  { // Hijo
+        if (!mask && !runs_on_thread(job, p))
+            mask = policy_mask(shell.affinity, shell.affinity_unit++);
+        
+        // Los comandos internos de una tubería en primer plano no crean un
+        // proceso: se ejecutan en un hilo (ver start_stages).
+        if (runs_on_thread(job, p)) {
+            open_stage_output(p, outfile);
+            outfile = STDOUT_FILENO;  // Ya es de la etapa.
+        }
+        else if ((p->pid = fork()) == 0)  { // Hijo
             
-            if (p->argc > 2 && *(p->args[p->argc-2]) == '>') {
+            if (p->outfile) {
                 
-                if (outfile != STDOUT_FILENO)
+                // La captura sigue siendo la salida de error: si se cerrase, fopen
+                // reutilizaría su número y los errores irían al fichero.
+                if (outfile != STDOUT_FILENO && outfile != errfile)
                     close(outfile);
                 
-                if ( (fich = fopen(p->args[p->argc-1], "w")) ) {
+                if ( (fich = fopen(p->outfile, "w")) )
                     outfile = fileno(fich);
-                    free(p->args[p->argc - 1]);
-                    free(p->args[p->argc - 2]);
-                    p->args[p->argc - 2] = NULL;
-                    p->argc -= 2;
-                }
                 else {
                     print_errno("fopen");
                     exit(errno);
@@ -419,14 +1009,17 @@ void launch_forked_job(Job * job) {
                 
             }
             
-            launch_process(p, infile, outfile,job->gpid,job->foreground);
+            launch_process(p, infile, outfile, errfile, job->gpid, job->foreground,
+                           job->foreground ? BG_NORMAL : job_priority(job), mask);
         }
         else {  // Padre
             
             if (job->gpid <= 0)
                 job->gpid = p->pid;
             
-            setpgid(p->pid, job->gpid);
+            if (shell.job_control)
+                setpgid(p->pid, job->gpid);
+            
             mark_process(job,0,p->pid);
         }
         
@@ -442,6 +1035,17 @@ void launch_forked_job(Job * job) {
         p = p->next;
     }
     
+    start_stages(job);
+    
+    // Sólo había etapas internas: no hay procesos a los que esperar.
+    if (job->gpid <= 0) {
+        wait_stages(job);
+        block_sig(SIGCHLD);
+        remove_job_ref(&shell.jobs, job);
+        unblock_sig(SIGCHLD);
+        return;
+    }
+    
     if (job->time_out != 0) 
         pthread_create(&tid,NULL, thread_time_out,job);
     
@@ -475,6 +1079,33 @@ int indexOfInternalProcess(Process * p) {
     return index;
 }
 
+/**
+ * Indica si un comando interno que sólo necesita un proceso fuera de la shell
+ * (ICMD_INLINE) puede ejecutarse en ella: en primer plano, sin tubería, sin
+ * redirección y sin time-out. sleep sigue creando un proceso, porque la shell
+ * ignora SIGTSTP y con Ctrl-Z no se podría detener ni pasar a background.
+ */
+
+static char runs_inline(Job * job, int index) {
+    return ICMD_INLINE(index) && index != cmd_sleep && job->foreground && !job->proc->next &&
+           !job->proc->outfile && job->time_out == 0;
+}
+
+/**
+ * Ejecuta un comando interno en la propia shell. El trabajo acaba con él, así
+ * que se elimina de la lista.
+ */
+
+static void run_inline(Job * job, int index) {
+    job->gpid = -1;
+    ICMD_HANDLER(index)(job->proc);
+    fflush(stdout);
+    
+    block_sig(SIGCHLD);
+    remove_job_ref(&shell.jobs, job);
+    unblock_sig(SIGCHLD);
+}
+
 void launch_job(Job * job) {
     int index;
     
@@ -483,7 +1114,9 @@ void launch_job(Job * job) {
     
     index = indexOfInternalProcess(job->proc);
     
-    if (index >= 0 && ICMD_HANDLER(index) && !ICMD_FORK(index)) {
+    if (index >= 0 && ICMD_HANDLER(index) && runs_inline(job, index))
+        run_inline(job, index);
+    else if (index >= 0 && ICMD_HANDLER(index) && !ICMD_FORK(index)) {
         job->gpid = -1;
         internalCommands.handler[index](job->proc);
         block_sig(SIGCHLD);
@@ -493,22 +1126,35 @@ void launch_job(Job * job) {
         
         unblock_sig(SIGCHLD);
     }
-    else
+    else if (!job->foreground && (next_queued_job(shell.jobs) || !admit_background_job())) {
+        enqueue_job(job);
+        print_info("Queued job ... command : %s, posición : %d\n", job->command,
+                   queue_position(shell.jobs, job));
+        
+        if (shell.pressure_cpu > 0 || shell.pressure_mem > 0)
+            arm_alarm();
+    }
+    else {
+        
+        // Los trabajos en background quedan bajo el control de presión.
+        if (!job->foreground && (shell.pressure_cpu > 0 || shell.pressure_mem > 0))
+            arm_alarm();
+        
         launch_forked_job(job);
+    }
     
 }
 
 void list_history(Process * p) {
-    int i = 1;
+    int i;
     HistoryLine line;
     
-    line = getFirstCommand(&shell.hist);
-
-    while (line) {
-        printf("%3d. %s\n", i, line->command);
-        i++;
-        nextCommand(&line);
-    }
+    // Las entradas descartadas que no estaban guardadas no se muestran.
+    for (i = 1 ; i <= shell.hist.total ; i++)
+        
+        if ( (line = getLine(&shell.hist, i)) )
+            fprintf(p->out, "%3d. %s\n", i, line->command);
+    
 }
 
 void cmd_hist_handler(Process * p) {
@@ -529,7 +1175,7 @@ void cmd_hist_handler(Process * p) {
 // ---------------------------------------------------------------------------//
 
 void cmd_rr_handler(Process * p) {
-    Job * job = search_job_by_process(shell.jobs, p->pid);
+    Job * job = search_job_by_proc(shell.jobs, p);
     int num, i;
     
     if (p->argc < 3) {
@@ -545,8 +1191,6 @@ void cmd_rr_handler(Process * p) {
     }
     
     // Eliminamos del proceso rr y el número.
-    free(p->args[0]); free(p->args[1]);
-    
     for (i = 0 ; i < p->argc - 1; i++)
         p->args[i] = p->args[i+2];
     
@@ -560,14 +1204,11 @@ void cmd_rr_handler(Process * p) {
     
     launch_forked_job(job);
     
-    kill(-job->gpid, SIGSTOP);
+    signal_job(job, SIGSTOP);
     kill_job(job, 0, SIGCONT);
     analyce_job_status(job);
     
-    if (!shell.sigalarm_on) {
-        alarm(1);
-        shell.sigalarm_on = 1;
-    }
+    arm_alarm();
 }
 
 void cmd_cd_handler(Process * p) {
@@ -606,6 +1247,17 @@ Job * search_process_by_number(int num) {
     return NULL;
 }
 
+int count_numbered_jobs() {
+    Job * job = shell.jobs;
+    int n = 0;
+    
+    for (; job ; job = job->next)
+        if (!job->foreground && job->gpid != -1)
+            n++;
+    
+    return n;
+}
+
 Job * check_fg_bg_command_line(Process * p, const char * cmd) {
     int number;
     Job * job;
@@ -632,7 +1284,15 @@ void cmd_fg_handler(Process * p) {
     
     fg_job = check_fg_bg_command_line(p,internalCommands.str_cmd[cmd_fg]);
 
-    if (fg_job) {
+    if (fg_job && fg_job->status == WAITING) {
+        printf("El trabajo está esperando a sus dependencias.\n");
+    }
+    else if (fg_job && fg_job->status == QUEUED) { // Se salta la cola.
+        fg_job->status = READY;
+        fg_job->foreground = 1;
+        launch_forked_job(fg_job);
+    }
+    else if (fg_job) {
         
         if (fg_job->respawnable) {
             printf("\"%s\" ya no es respawnable\n", fg_job->command);
@@ -652,7 +1312,13 @@ void cmd_bg_handler(Process * p) {
     
     bg_job = check_fg_bg_command_line(p,internalCommands.str_cmd[cmd_bg]);
 
-    if (bg_job) {
+    if (bg_job && bg_job->status == WAITING) {
+        printf("El trabajo está esperando a sus dependencias.\n");
+    }
+    else if (bg_job && bg_job->status == QUEUED) {
+        printf("El trabajo está en la cola, posición %d.\n", queue_position(shell.jobs, bg_job));
+    }
+    else if (bg_job) {
         
         if (bg_job->respawnable) {
             printf("\"%s\" ya no es respawnable\n", bg_job->command);
@@ -673,7 +1339,7 @@ void cmd_jobs_handler(Process * p) {
     while (j) {
         
         if (!j->foreground) {
-            print_job_state(i,j);
+            print_job_state(p->out, i, j);
             i++;
         }
         
@@ -681,7 +1347,7 @@ void cmd_jobs_handler(Process * p) {
     }
     
     if (i == 1)
-        printf("No hay trabajos pendientes.\n");
+        fprintf(p->out, "No hay trabajos pendientes.\n");
     
 }
 
@@ -698,13 +1364,13 @@ void * thread_time_out(void * attr) {
     if (job->time_out > 0)
         sleep(job->time_out);
     
-    if ( waitpid(-job->gpid,NULL, WNOHANG) >= 0)
-        kill(-job->gpid, SIGTERM);
+    if ( !shell.job_control || waitpid(-job->gpid,NULL, WNOHANG) >= 0)
+        signal_job(job, SIGTERM);
 }
 
 void cmd_timeout_handler(Process * p) {
     int i;
-    Job * job = search_job_by_process(shell.jobs,p->pid);
+    Job * job = search_job_by_proc(shell.jobs, p);
     
     if (p->argc < 3 )  {
         cmd_error_timeout();
@@ -717,7 +1383,6 @@ void cmd_timeout_handler(Process * p) {
         job->time_out = -1;
     
     // Eliminamos del proceso time-out y el tiempo
-    free(p->args[0]); free(p->args[1]);
     for (i = 0 ; i < p->argc - 1; i++)
         p->args[i] = p->args[i+2];
     p->argc -= 2;
@@ -727,31 +1392,306 @@ void cmd_timeout_handler(Process * p) {
 
 void notify_and_clean_jobs() {
     Job * job = shell.jobs;
+    Job * next;
     int i = 1;
     
     block_sig(SIGCHLD);
     printf(C_GREEN);
     while (job && shell.jobs) {
+        next = job->next;
         
         if (!job->foreground && IS_JOB_ENDED(job->status)) {
-            print_job_state(i,job);
-            remove_job(&shell.jobs, job->gpid);
+            print_job_state(stdout, i, job);
+            remove_job_ref(&shell.jobs, job);
+            i++;
         }
-        else if (job->notify) {
-            print_job_state(i, job);
-            job->notify = 0; 
+        else {
+            
+            if (job->notify) {
+                print_job_state(stdout, i, job);
+                job->notify = 0; 
+            }
+            
+            if (!job->foreground)
+                i++;
         }
-
-        if (!job->foreground)
-            i++;
         
-        job = job->next;
+        job = next;
     }
     printf(C_DEFAULT);fflush(stdout);
+    dispatch_ready_jobs();
     unblock_sig(SIGCHLD);
     
 }
 
+/**
+ * Elimina los n primeros argumentos de un proceso.
+ * 
+ * @param p  Proceso.
+ * @param n  Número de argumentos a eliminar.
+ */
+
+static void shift_args(Process * p, int n) {
+    int i;
+    
+    // Los argumentos están en el bloque del trabajo: no se liberan.
+    for (i = 0 ; i <= p->argc - n ; i++)
+        p->args[i] = p->args[i + n];
+    
+    p->argc -= n;
+}
+
+/**
+ * Elimina un trabajo after que no se pudo lanzar, para que no ocupe un número
+ * ni aparezca en jobs.
+ */
+
+static void discard_after_job(Job * job) {
+    block_sig(SIGCHLD);
+    remove_job_ref(&shell.jobs, job);
+    unblock_sig(SIGCHLD);
+}
+
+void cmd_after_handler(Process * p) {
+    Job * job = search_job_by_proc(shell.jobs, p);
+    Job * dep;
+    char * num;
+    
+    if (p->argc < 3) {
+        print_error("Formato: after <num>[,<num>...] <command>\n");
+        discard_after_job(job);
+        return;
+    }
+    
+    // Las dependencias ya terminadas con éxito no cuentan; si alguna falló, el
+    // trabajo no se lanza.
+    for (num = strtok(p->args[1], ",") ; num ; num = strtok(NULL, ",")) {
+        dep = search_process_by_number(atoi(num));
+        
+        if (dep == NULL) {
+            print_error("%s : el trabajo %s no existe.\n", CMDAFTER, num);
+            discard_after_job(job);
+            return;
+        }
+        
+        if (IS_JOB_ENDED(dep->status) && (dep->status != COMPLETED || *(dep->info) != 0)) {
+            print_error("%s : el trabajo %s terminó con error.\n", CMDAFTER, num);
+            discard_after_job(job);
+            return;
+        }
+        
+        if (!IS_JOB_ENDED(dep->status) && !add_job_dependency(job, dep)) {
+            print_error("%s : demasiadas dependencias (máximo %d).\n", CMDAFTER, MAX_DEPS);
+            discard_after_job(job);
+            return;
+        }
+        
+    }
+    
+    // Eliminamos del proceso after y las dependencias.
+    shift_args(p, 2);
+    job->gpid = 0;
+    job->status = READY;
+    
+    if (job->ndeps == 0)
+        launch_job(job);
+    else {
+        job->foreground = 0;
+        job->status = WAITING;
+        print_info("Waiting job ... command : %s, dependencias : %d\n", job->command, job->ndeps);
+    }
+    
+}
+
+static const char * bool_values[] = {"off", "on", NULL};
+static const char * bg_priority_values[] = BG_PRIORITY_NAMES;
+static const char * affinity_values[] = AFFINITY_NAMES;
+
+ShellOption shellOptions[] = {
+    {"max-jobs", &shell.max_bg_jobs, NULL},
+    {"pressure-cpu", &shell.pressure_cpu, NULL},
+    {"pressure-mem", &shell.pressure_mem, NULL},
+    {"pressure-stop", &shell.pressure_stop, bool_values},
+    {"bg-priority", &shell.bg_priority, bg_priority_values},
+    {"affinity", &shell.affinity, affinity_values},
+    {"capture", &shell.capture, bool_values},
+    {"mux", &shell.mux, bool_values},
+    {"hist-dedup", &shell.hist.dedup, bool_values},
+    {NULL, NULL, NULL}
+};
+
+static void print_option(ShellOption * opt) {
+    
+    if (opt->values)
+        printf("%-15s %s\n", opt->name, opt->values[*(opt->value)]);
+    else
+        printf("%-15s %d\n", opt->name, *(opt->value));
+    
+}
+
+void cmd_set_handler(Process * p) {
+    ShellOption * opt = shellOptions;
+    char * end;
+    long number;
+    int value;
+    
+    if (p->argc < 2) {
+        
+        for (; opt->name ; opt++)
+            print_option(opt);
+        
+        return;
+    }
+    
+    while (opt->name && strcmp(opt->name, p->args[1]) != 0)
+        opt++;
+    
+    if (!opt->name) {
+        print_error("%s : opción %s desconocida.\n", CMDSET, p->args[1]);
+        return;
+    }
+    
+    if (p->argc < 3) {
+        print_option(opt);
+        return;
+    }
+    
+    if (opt->values) {
+        
+        for (value = 0 ; opt->values[value] && strcmp(opt->values[value], p->args[2]) ; value++);
+        
+        if (!opt->values[value]) {
+            print_error("%s : valor %s no válido para %s.\n", CMDSET, p->args[2], opt->name);
+            return;
+        }
+        
+    }
+    else {
+        errno = 0;
+        number = strtol(p->args[2], &end, 10);
+        
+        // Sólo dígitos: "5abc", "-1" o " 5" no se aceptan.
+        if (!isdigit(*(p->args[2])) || *end != '\0' || errno == ERANGE || number > INT_MAX) {
+            print_error("%s : %s debe ser un número positivo.\n", CMDSET, opt->name);
+            return;
+        }
+        
+        value = (int) number;
+    }
+    
+    *(opt->value) = value;
+    
+    // Un cambio en los límites puede dejar huecos libres.
+    block_sig(SIGCHLD);
+    dispatch_ready_jobs();
+    unblock_sig(SIGCHLD);
+    
+    if (shell.pressure_cpu > 0 || shell.pressure_mem > 0)
+        arm_alarm();
+}
+
+void cmd_prio_handler(Process * p) {
+    Job * job = search_job_by_proc(shell.jobs, p);
+    int prio;
+    
+    if (p->argc < 3) {
+        print_error("Formato: prio <normal|nice|batch|idle> <command>\n");
+        return;
+    }
+    
+    for (prio = 0 ; bg_priority_values[prio] && strcmp(bg_priority_values[prio], p->args[1]) ; prio++);
+    
+    if (!bg_priority_values[prio]) {
+        print_error("%s : política %s desconocida.\n", CMDPRIO, p->args[1]);
+        return;
+    }
+    
+    // Eliminamos del proceso prio y la política.
+    shift_args(p, 2);
+    job->priority = prio;
+    job->gpid = 0;
+    launch_job(job);
+}
+
+void cmd_taskset_handler(Process * p) {
+    Job * job = search_job_by_proc(shell.jobs, p);
+    CpuMask * mask;
+    
+    // La máscara se aplica a todo el trabajo, incluidas las réplicas de rr.
+    if ( !(mask = strip_taskset(p)) )
+        return;
+    
+    free(job->cpus);
+    job->cpus = mask;
+    job->gpid = 0;
+    launch_job(job);
+}
+
+void cmd_capture_handler(Process * p) {
+    Job * job = search_job_by_proc(shell.jobs, p);
+    
+    if (p->argc < 2) {
+        print_error("Formato: capture <command> &\n");
+        return;
+    }
+    
+    // Eliminamos del proceso capture.
+    shift_args(p, 1);
+    job->capture = 1;
+    job->gpid = 0;
+    launch_job(job);
+}
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
+
+void cmd_output_handler(Process * p) {
+    OutputRing * out = shell.outputs;
+    void (*old)(int);
+    unsigned long pos, head;
+    char closed;
+    
+    if (p->argc < 2) {
+        
+        if (!out)
+            printf("No hay salidas capturadas.\n");
+        
+        // El hilo de cada salida actualiza head y closed: se leen con su cerrojo.
+        for (; out ; out = out->next) {
+            closed = output_status(out, &head);
+            printf("[%d]\t%-10s %8lu bytes\t%s\n", out->id, closed ? "Cerrada" : "Abierta",
+                   head, out->command);
+        }
+        
+        return;
+    }
+    
+    if ( !(out = search_output(shell.outputs, atoi(p->args[1]))) ) {
+        print_error("%s : la salida %s no existe.\n", CMDOUT, p->args[1]);
+        return;
+    }
+    
+    fflush(stdout);
+    pos = write_output(out, 0, STDOUT_FILENO);
+    
+    if (p->argc > 2 && strcmp(p->args[2], "--follow") == 0) {
+        // Se sigue hasta que se cierre la salida o se pulse Ctrl-C.
+        interrupted = 0;
+        old = signal(SIGINT, on_interrupt);
+        
+        while (!interrupted && (!output_status(out, &head) || head != pos))
+            
+            if (wait_output(out, pos, 200))
+                pos = write_output(out, pos, STDOUT_FILENO);
+        
+        signal(SIGINT, old);
+    }
+    
+}
+
 void cmd_exit_handler() {
     destroy_shell();
     printf("Bye\n");
@@ -773,32 +1713,33 @@ void chidlren_inc_list(ListChildren list, pid_t pid) {
     
 }
 
-void cmd_children_handler() {
+void cmd_children_handler(Process * p) {
     ListChildren list = NULL;
     ListChildren * mlist = &list;
     DIR * dp;
     struct dirent * entry;
     FILE * fstat;
     char buff[50];
+    char path[PATH_MAX];
     int ti;
     long ll;
     double ld;
     
+    // Se puede ejecutar dentro de la shell: no cambia de directorio ni sale.
     if ( ! (dp = opendir("/proc")) ) {
         print_error("No se pudo habrír el directorio /proc\n");
-        exit(errno);
+        p->info = errno;
+        return;
     }
     
-    chdir("/proc");
-    
     while ( (entry = readdir(dp)) ) {
         
-        if (entry->d_type == DT_DIR && isdigit(entry->d_name[0])) {
+        snprintf(path, PATH_MAX, "/proc/%s/stat", entry->d_name);
+        
+        if (entry->d_type == DT_DIR && isdigit(entry->d_name[0]) && (fstat = fopen(path, "r"))) {
             *mlist = (InfoProcess *) malloc(sizeof(InfoProcess));
             (*mlist)->childs = 0;
             
-            chdir(entry->d_name);
-            fstat = fopen("stat","r");
             fscanf(fstat,"%d",&((*mlist)->pid)); // pid
             fscanf(fstat,"%s %c", (*mlist)->comm, &buff[0]); // comn ,status
             *((*mlist)->comm) = ' ';
@@ -808,18 +1749,19 @@ void cmd_children_handler() {
                    &ti,&ti,&ti,&ti,&ti,&ll,&ll,&ll,&ll,&ll,&ll,&ll,&ll,&ll,&ll);
             fscanf(fstat, "%ld", &((*mlist)->threads));
             fclose(fstat);
-            chdir("..");
             mlist = &((*mlist)->next);
         }
         
     }
     
+    *mlist = NULL;
+    
     for (mlist = &list ; *mlist ; mlist = &((*mlist)->next)) 
         chidlren_inc_list(list, (*mlist)->ppid);    
 
-    printf(" %-6s %-18s %-6s %-6s\n", "PID", "COMMAND", "CHILDREN", "THREADS");
+    fprintf(p->out, " %-6s %-18s %-6s %-6s\n", "PID", "COMMAND", "CHILDREN", "THREADS");
     for (mlist = &list ; *mlist ; mlist = &((*mlist)->next)) 
-        printf(" %-6d %-18s %6d %6ld\n", (*mlist)->pid, (*mlist)->comm,
+        fprintf(p->out, " %-6d %-18s %6d %6ld\n", (*mlist)->pid, (*mlist)->comm,
                 (*mlist)->childs, (*mlist)->threads);
     
     // destroy list.
@@ -845,24 +1787,92 @@ void config_internal_commands() {
     LINK_CMD(cmd_hist, cmd_hist_handler);
     LINK_CMD(cmd_timeout, cmd_timeout_handler);
     LINK_CMD(cmd_children, cmd_children_handler);
+    LINK_CMD(cmd_after, cmd_after_handler);
+    LINK_CMD(cmd_set, cmd_set_handler);
+    LINK_CMD(cmd_prio, cmd_prio_handler);
+    LINK_CMD(cmd_taskset, cmd_taskset_handler);
+    LINK_CMD(cmd_capture, cmd_capture_handler);
+    LINK_CMD(cmd_output, cmd_output_handler);
+    LINK_CMD(cmd_true, cmd_true_handler);
+    LINK_CMD(cmd_false, cmd_false_handler);
+    LINK_CMD(cmd_echo, cmd_echo_handler);
+    LINK_CMD(cmd_printf, cmd_printf_handler);
+    LINK_CMD(cmd_sleep, cmd_sleep_handler);
+    LINK_CMD(cmd_test, cmd_test_handler);
+}
+
+void config_completion() {
+    int i;
+    
+    for (i = 0 ; i < ICMD_TOTAL ; i++)
+        addBuiltin(ICMD_STR(i));
+    
+    addJobCommand(ICMD_STR(cmd_fg));
+    addJobCommand(ICMD_STR(cmd_bg));
+    setJobCounter(count_numbered_jobs);
 }
 
 // ---------------------------------------------------------------------------//
 // ---------------------------------- MAIN------------------------------------//
 // ---------------------------------------------------------------------------//
 
+/**
+ * Ejecuta los comandos de un fichero, uno por línea, sin pasar por el editor
+ * ni por el historial. Las líneas vacías y las que empiezan por # se ignoran.
+ * Los comandos se leen de la caché del fichero (ver script.h), cuyas palabras
+ * usan los trabajos sin copiarlas. Al acabar el fichero se sale de la shell.
+ * 
+ * @param path  Ruta del fichero.
+ */
+
+void run_script(const char * path) {
+    Script sc;
+    CommandLine line;
+    const char * cmd;
+    int res;
+    
+    if (open_script(path, &sc) < 0) {
+        perror(path);
+        destroy_shell();
+        exit(-1);
+    }
+    
+    while ((res = next_script_line(&sc, &cmd, &line)) > 0) {
+        notify_and_clean_jobs();
+        
+        if (line.overflow) {
+            print_error("Demasiados argumentos o etapas en la tubería.\n");
+        }
+        else
+            launch_job(create_parsed_job(&shell.jobs, cmd, &line));
+    }
+    
+    if (res < 0) {
+        print_error("%s : caché dañada; bórrela para volver a generarla.\n", path);
+    }
+    
+    destroy_shell();  // Los trabajos apuntan a la caché: se destruyen antes.
+    close_script(&sc);
+    exit(0);
+}
+
 int main(int argc, char ** argv) {
     char * cmd;
+    CommandLine line;
     Job * job;
 
-    init_shell(&shell);
+    init_shell(argc <= 1);
     config_internal_commands();
+    config_completion();
+    
+    if (argc > 1)
+        run_script(argv[1]);
 
     do {
-        cmd = getCommand(&(shell.hist));    // 1. Leo el comando.
-        notify_and_clean_jobs();            // 2. Notifico y elimino los trabajos pendientes.
-        job = create_job(&shell.jobs,cmd);  // 3. Creo el trabajo nuevo.
-        launch_job(job);                    // 4. Se ejecuta.
+        cmd = getCommand(&(shell.hist), &line);         // 1. Leo y analizo el comando.
+        notify_and_clean_jobs();                        // 2. Notifico y elimino los trabajos pendientes.
+        job = create_parsed_job(&shell.jobs,cmd,&line); // 3. Creo el trabajo nuevo.
+        launch_job(job);                                // 4. Se ejecuta.
     } while (1);
 
     return 0;
@@ -0,0 +1,119 @@
+/**
+ * Mide cuántas líneas por segundo analiza parse_line con cada versión de la
+ * búsqueda de delimitadores. Si no se le pasa un fichero, genera uno de
+ * BENCH_LINES líneas en /tmp.
+ *
+ * Uso: bench_parser [fichero]
+ */
+
+#include <defs.h>
+#include <parser.h>
+#include <scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LINES 1000000
+#define BENCH_FILE  "/tmp/bench_parser.txt"
+
+static const char * templates[] = {
+    "ls -la /usr/share/doc/%d | grep -v README | wc -l",
+    "echo \"linea numero %d con varias palabras\" > /tmp/salida.txt &",
+    "find /var/lib/apt/lists/ -name paquete_%d -newer /etc/hostname | sort | uniq -c | sort -rn | head",
+    "sleep %d +",
+    "cat /proc/self/status /proc/self/limits /proc/self/mountinfo /proc/self/cgroup | tr a-z A-Z | cut -c1-%d",
+};
+
+static void generate(const char * path) {
+    FILE * f = fopen(path, "w");
+    int i, n = sizeof (templates) / sizeof (templates[0]);
+    
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    
+    for (i = 0 ; i < BENCH_LINES ; i++) {
+        fprintf(f, templates[i % n], i);
+        fputc('\n', f);
+    }
+    
+    fclose(f);
+}
+
+// Lee el fichero entero y separa las líneas con '\0'.
+static char * load(const char * path, long * size, int * nlines) {
+    FILE * f = fopen(path, "r");
+    char * text, * p;
+    
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    text = malloc(*size + 1);
+    
+    if (fread(text, 1, *size, f) != *size) {
+        perror(path);
+        exit(1);
+    }
+    
+    text[*size] = '\0';
+    fclose(f);
+    
+    for (*nlines = 0, p = text ; (p = strchr(p, '\n')) ; (*nlines)++)
+        *p++ = '\0';
+    
+    return text;
+}
+
+int main(int argc, char ** argv) {
+    static const char * names[] = {"escalar", "SSE2", "AVX2"};
+    const char * path = argc > 1 ? argv[1] : BENCH_FILE;
+    struct timespec start, end;
+    CommandLine cl;
+    char * text, * p;
+    long size, words, reference = -1;
+    int level, i, nlines;
+    double secs;
+    
+    if (argc == 1)
+        generate(path);
+    
+    text = load(path, &size, &nlines);
+    
+    for (level = SCAN_SCALAR ; level <= SCAN_AVX2 ; level++) {
+        
+        if (scan_select(level) != level) {
+            printf("%-8s no disponible\n", names[level]);
+            continue;
+        }
+        
+        words = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        
+        for (i = 0, p = text ; i < nlines ; i++, p += strlen(p) + 1) {
+            parse_line(p, &cl, NULL, NULL);
+            words += cl.size;
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        
+        printf("%-8s %10.0f líneas/s %8.1f MB/s\n", names[level], nlines / secs, size / secs / 1e6);
+        
+        // Todas las versiones tienen que ver las mismas palabras.
+        if (reference >= 0 && words != reference)
+            printf("%-8s resultado distinto: %ld != %ld\n", names[level], words, reference);
+        
+        reference = words;
+    }
+    
+    free(text);
+    
+    return 0;
+}
@@ -1,8 +1,10 @@
 
 #include <defs.h>
 #include <jobs_control.h>
+#include <parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 /// INIT_JOB
@@ -38,7 +40,7 @@ void t_create_job_3() {
 void t_create_job_4() {
     ListJobs lj = NULL;
     printf("Testing 4 ...");
-    assert(create_job(&lj, "")->proc->args[0] == '\0');
+    assert(create_job(&lj, "")->proc->args[0] == NULL);
     printf("OK!\n");
 }
 
@@ -241,6 +243,144 @@ void t_create_job_18() {
     printf("...OK!\n");
 }
 
+// respawnable (+): va a background.
+void t_create_job_19() {
+    ListJobs lj = NULL;
+    Job * job;
+    printf("Testing 19 ...");
+    job = create_job(&lj, "c 1 +");
+    assert(strcmp(job->proc->args[0], "c") == 0);
+    assert(strcmp(job->proc->args[1], "1") == 0);
+    assert(job->proc->args[2] == NULL);
+    assert(job->respawnable);
+    assert(!job->foreground);
+    printf("OK!\n");
+}
+
+// redirección: el fichero no es un argumento.
+void t_create_job_20() {
+    ListJobs lj = NULL;
+    Job * job;
+    printf("Testing 20 ...");
+    job = create_job(&lj, "c 1 > f");
+    assert(strcmp(job->proc->args[0], "c") == 0);
+    assert(strcmp(job->proc->args[1], "1") == 0);
+    assert(job->proc->args[2] == NULL);
+    assert(strcmp(job->proc->outfile, "f") == 0);
+    assert(job->foreground);
+    printf("OK!\n");
+}
+
+// redirección sin espacios y en la última etapa de una tubería.
+void t_create_job_21() {
+    ListJobs lj = NULL;
+    Job * job;
+    printf("Testing 21 ...");
+    job = create_job(&lj, "c 1 | c2>f &");
+    assert(job->proc->outfile == NULL);
+    assert(strcmp(job->proc->next->args[0], "c2") == 0);
+    assert(job->proc->next->args[1] == NULL);
+    assert(strcmp(job->proc->next->outfile, "f") == 0);
+    assert(!job->foreground);
+    printf("OK!\n");
+}
+
+// las comillas protegen los separadores: una sola etapa.
+void t_create_job_22() {
+    ListJobs lj = NULL;
+    Job * job;
+    printf("Testing 22 ...");
+    job = create_job(&lj, "c 'a | b > f &'");
+    assert(strcmp(job->proc->args[1], "'a | b > f &'") == 0);
+    assert(job->proc->args[2] == NULL);
+    assert(job->proc->next == NULL);
+    assert(job->proc->outfile == NULL);
+    assert(job->foreground);
+    printf("OK!\n");
+}
+
+// etapas fuera de rango: se descartan las que sobran.
+void t_create_job_23() {
+    int i = 0;
+    ListJobs lj = NULL;
+    Job * job;
+    Process * p;
+    CommandLine cl;
+    char cmd [MAX_LINE_COMMAND];
+    char * ptr = cmd;
+    
+    printf("Testing 23 ...");
+    
+    for (i = 0 ; i < MAX_STAGES + 1 ; i++)  {
+        strcpy(ptr, "c | ");
+        ptr += 4;
+    }
+    
+    *(ptr - 3) = '\0';
+    parse_line(cmd, &cl, NULL, NULL);
+    assert(cl.overflow);
+    job = create_parsed_job(&lj, cmd, &cl);
+    
+    for (i = 0, p = job->proc ; p ; p = p->next)
+        i++;
+    
+    assert(i == MAX_STAGES);
+    printf("OK!\n");
+}
+
+static const char * lookup(int n, void * ctx) {
+    (void) ctx;
+    return n == 1 ? "ls -l | wc" : NULL;
+}
+
+// historial N se expande a la entrada N.
+void t_create_job_24() {
+    ListJobs lj = NULL;
+    Job * job;
+    CommandLine cl;
+    printf("Testing 24 ...");
+    parse_line("historial 1 > f", &cl, lookup, NULL);
+    assert(cl.expanded);
+    job = create_parsed_job(&lj, "historial 1 > f", &cl);
+    assert(strcmp(job->proc->args[0], "ls") == 0);
+    assert(strcmp(job->proc->args[1], "-l") == 0);
+    assert(job->proc->args[2] == NULL);
+    assert(strcmp(job->proc->next->args[0], "wc") == 0);
+    assert(job->proc->next->args[1] == NULL);
+    assert(strcmp(job->proc->next->outfile, "f") == 0);
+    printf("OK!\n");
+}
+
+// sin entrada, o sin lookup, historial N se queda como está.
+void t_create_job_25() {
+    ListJobs lj = NULL;
+    Job * job;
+    CommandLine cl;
+    printf("Testing 25 ...");
+    parse_line("historial 2", &cl, lookup, NULL);
+    assert(!cl.expanded);
+    job = create_parsed_job(&lj, "historial 2", &cl);
+    assert(strcmp(job->proc->args[0], "historial") == 0);
+    assert(strcmp(job->proc->args[1], "2") == 0);
+    assert(job->proc->args[2] == NULL);
+    job = create_job(&lj, "historial 1");
+    assert(strcmp(job->proc->args[0], "historial") == 0);
+    assert(strcmp(job->proc->args[1], "1") == 0);
+    printf("OK!\n");
+}
+
+// la forma normalizada de una línea expandida.
+void t_create_job_26() {
+    CommandLine cl;
+    char buff[MAX_LINE_COMMAND];
+    printf("Testing 26 ...");
+    parse_line("  historial 1   &", &cl, lookup, NULL);
+    assert(unparse_line(&cl, buff, sizeof(buff)) == 0);
+    assert(strcmp(buff, "ls -l | wc &") == 0);
+    assert(unparse_line(&cl, buff, 5) == -1);
+    printf("OK!\n");
+}
+
 void t_create_job() {
     printf("\nTesting create_job ...\n");
     t_create_job_1();
@@ -261,6 +401,14 @@ void t_create_job() {
     t_create_job_16();
     t_create_job_17();
     t_create_job_18();
+    t_create_job_19();
+    t_create_job_20();
+    t_create_job_21();
+    t_create_job_22();
+    t_create_job_23();
+    t_create_job_24();
+    t_create_job_25();
+    t_create_job_26();
     printf("..... All right!\n");
     
 }
@@ -354,53 +502,73 @@ void t_linked_list_job() {
     printf("... All Right!\n");
 }
 
+// Un proceso lanzado pasa a ejecución.
 void t_analyce_next_status_1() {
-    Job job;
+    ListJobs lj = NULL;
+    Job * job;
     
-    job.status = READY;
-    job.foreground = 1;
+    job = create_job(&lj, "c");
+    job->proc->pid = 100;
     
     printf("Testing 1 ...");
-    analize_next_state(&job, 0, 0, 1);
-    assert(job.status == RUNNING );
-    assert(job.foreground);
+    mark_process(job, 0, 100);
+    analyce_job_status(job);
+    assert(job->proc->state == RUNNING);
+    assert(job->status == RUNNING );
+    assert(job->foreground);
     printf("OK!\n");
 }
 
 void t_analyce_next_status_2() {
-    Job job;
+    ListJobs lj = NULL;
+    Job * job;
     
-    job.status = job_ready;
-    job.foreground = 0;
+    job = create_job(&lj, "c &");
+    job->proc->pid = 100;
     
     printf("Testing 2 ...");
-    analize_next_state(&job, 0, 0, 1);
-    assert(job.status == job_executed );
-    assert(!job.foreground);
+    mark_process(job, 0, 100);
+    analyce_job_status(job);
+    assert(job->status == RUNNING );
+    assert(!job->foreground);
     printf("OK!\n");
 }
 
+// Un pid que no es del trabajo no cambia nada.
 void t_analyce_next_status_3() {
-    Job job;
+    ListJobs lj = NULL;
+    Job * job;
     
-    job.status = job_ready;
-    job.foreground = 1;
+    job = create_job(&lj, "c");
+    job->proc->pid = 100;
     
     printf("Testing 3 ...");
-    analize_next_state(&job, 0, 0, 0);
-    assert(job.status == job_ready );
+    mark_process(job, 0, 101);
+    assert(job->proc->state == READY);
+    assert(job->status == READY );
     printf("OK!\n");
 }
 
+// Sólo cambia la etapa con ese pid; el trabajo acaba cuando acaban todas.
 void t_analyce_next_status_4() {
-    Job job;
+    ListJobs lj = NULL;
+    Job * job;
     
-    job.status = job_ready;
-    job.foreground = 0;
+    job = create_job(&lj, "c | c2 &");
+    job->proc->pid = 100;
+    job->proc->next->pid = 101;
     
     printf("Testing 4 ...");
-    analize_next_state(&job, 0, 0, 0);
-    assert(job.status == job_ready );
+    mark_process(job, 0, 100);
+    mark_process(job, 0, 101);
+    mark_process(job, 0, 100);      // WIFEXITED, status 0.
+    analyce_job_status(job);
+    assert(job->proc->state == COMPLETED);
+    assert(job->proc->next->state == RUNNING);
+    assert(job->status == RUNNING );
+    mark_process(job, 0, 101);
+    analyce_job_status(job);
+    assert(job->status == COMPLETED );
     printf("OK!\n");
 }
 
@@ -0,0 +1,155 @@
+/**
+ * Implementación del índice de trigramas.
+ * 
+ * @file  trigram.c
+ * @autor Víctor Manuel Ortiz Guardeño
+ * @date  19/10/2026
+ */
+
+#include <trigram.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS 1024
+
+static uint32_t keyOf(const char * tri) {
+    return (unsigned char) tri[0] << 16 | (unsigned char) tri[1] << 8 | (unsigned char) tri[2];
+}
+
+static uint32_t slotOf(TrigramIndex * idx, uint32_t key) {
+    uint32_t i = (key * 2654435761u) & idx->mask;
+    
+    while (idx->table[i].key && idx->table[i].key != key)
+        i = (i + 1) & idx->mask;
+    
+    return i;
+}
+
+/**
+ * Dobla el tamaño de la tabla cuando está medio llena.
+ */
+
+static void grow(TrigramIndex * idx) {
+    Posting * old = idx->table;
+    uint32_t size = idx->mask + 1, i;
+    
+    idx->table = (Posting *) calloc(2 * size, sizeof(Posting));
+    idx->mask = 2 * size - 1;
+    
+    for (i = 0 ; i < size ; i++)
+        
+        if (old[i].key)
+            idx->table[slotOf(idx, old[i].key)] = old[i];
+    
+    free(old);
+}
+
+void initTrigrams(TrigramIndex * idx) {
+    idx->table = (Posting *) calloc(INITIAL_SLOTS, sizeof(Posting));
+    idx->mask = INITIAL_SLOTS - 1;
+    idx->used = 0;
+}
+
+void addTrigrams(TrigramIndex * idx, int n, const char * text, int len) {
+    Posting * list;
+    uint32_t key;
+    int i;
+    
+    for (i = 0 ; i + 3 <= len ; i++) {
+        
+        // Las claves son siempre distintas de 0: el texto no tiene '\0'.
+        if ( !(key = keyOf(text + i)) )
+            continue;
+        
+        if (2 * (idx->used + 1) > idx->mask + 1)
+            grow(idx);
+        
+        list = &idx->table[slotOf(idx, key)];
+        
+        if (!list->key) {
+            list->key = key;
+            idx->used++;
+        }
+        
+        while (list->count > 0 && list->nums[list->count - 1] > n)
+            list->count--;
+        
+        if (list->count > 0 && list->nums[list->count - 1] == n)
+            continue;
+        
+        if (list->count == list->size) {
+            list->size = list->size ? 2 * list->size : 4;
+            list->nums = (int *) realloc(list->nums, list->size * sizeof(int));
+        }
+        
+        list->nums[list->count++] = n;
+    }
+    
+}
+
+void mergeTrigrams(TrigramIndex * idx, TrigramIndex * older) {
+    Posting * list, * old;
+    uint32_t i;
+    
+    for (i = 0 ; i <= older->mask ; i++) {
+        old = &older->table[i];
+        
+        if (!old->key || old->count == 0)
+            continue;
+        
+        if (2 * (idx->used + 1) > idx->mask + 1)
+            grow(idx);
+        
+        list = &idx->table[slotOf(idx, old->key)];
+        
+        if (!list->key) {
+            list->key = old->key;
+            idx->used++;
+        }
+        
+        if (list->count + old->count > list->size) {
+            list->size = list->count + old->count;
+            list->nums = (int *) realloc(list->nums, list->size * sizeof(int));
+        }
+        
+        // Las entradas anteriores van delante: la lista sigue en orden creciente.
+        memmove(list->nums + old->count, list->nums, list->count * sizeof(int));
+        memcpy(list->nums, old->nums, old->count * sizeof(int));
+        list->count += old->count;
+    }
+    
+    destroyTrigrams(older);
+}
+
+const Posting * findTrigram(TrigramIndex * idx, const char * tri) {
+    Posting * list = &idx->table[slotOf(idx, keyOf(tri))];
+    
+    return list->key && list->count > 0 ? list : NULL;
+}
+
+char postingHas(const Posting * list, int n) {
+    int lo = 0, hi = list->count - 1, mid;
+    
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        
+        if (list->nums[mid] == n)
+            return 1;
+        else if (list->nums[mid] < n)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    
+    return 0;
+}
+
+void destroyTrigrams(TrigramIndex * idx) {
+    uint32_t i;
+    
+    for (i = 0 ; i <= idx->mask ; i++)
+        free(idx->table[i].nums);
+    
+    free(idx->table);
+    idx->table = NULL;
+}